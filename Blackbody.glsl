@@ -0,0 +1,13 @@
+// Star and dust colors by temperature, for every pass that shades particles.
+#include "Galaxy.glsl"
+
+// blackbody colors from blackbodyMinTemp to blackbodyMaxTemp, one per texel center,
+// generated by the host (Blackbody.h) and linearly filtered
+layout (binding = 8) uniform sampler1D blackbodyColors;
+
+vec3 color_from_temp(float temp)
+{
+	float size = float(textureSize(blackbodyColors, 0));
+	float t = clamp((temp - blackbodyMinTemp) / (blackbodyMaxTemp - blackbodyMinTemp), 0.0, 1.0);
+	return textureLod(blackbodyColors, (t * (size - 1.0) + 0.5) / size, 0.0).rgb;
+}
@@ -0,0 +1,55 @@
+#version 430 core
+// Dual filter (Kawase) bloom. BLOOM_DOWNSAMPLE halves the source with a 5 tap filter,
+// BLOOM_UPSAMPLE doubles it with an 8 tap tent and is added onto the next larger level.
+out vec4 FragColor;
+in vec2 TexCoords;
+
+uniform sampler2D sourceTexture;
+// size of one source texel in uv
+uniform vec2 texelSize;
+
+#if defined(BLOOM_DOWNSAMPLE)
+
+// only set for the first level, keeps the mid tones out of the chain
+uniform bool prefilter;
+uniform float threshold;
+uniform float exposure;
+
+vec3 applyThreshold(vec3 color)
+{
+	float brightness = max(color.r, max(color.g, color.b)) * exposure;
+	return color * max(brightness - threshold, 0.0) / max(brightness, 1e-4);
+}
+
+void main()
+{
+	vec2 halfTexel = texelSize * 0.5;
+	vec3 sum = texture(sourceTexture, TexCoords).rgb * 4.0;
+	sum += texture(sourceTexture, TexCoords - halfTexel).rgb;
+	sum += texture(sourceTexture, TexCoords + halfTexel).rgb;
+	sum += texture(sourceTexture, TexCoords + vec2(halfTexel.x, -halfTexel.y)).rgb;
+	sum += texture(sourceTexture, TexCoords - vec2(halfTexel.x, -halfTexel.y)).rgb;
+	vec3 color = sum / 8.0;
+
+	if(prefilter)
+		color = applyThreshold(color);
+	FragColor = vec4(color, 1.0);
+}
+
+#elif defined(BLOOM_UPSAMPLE)
+
+void main()
+{
+	vec2 halfTexel = texelSize * 0.5;
+	vec3 sum = texture(sourceTexture, TexCoords + vec2(-halfTexel.x * 2.0, 0.0)).rgb;
+	sum += texture(sourceTexture, TexCoords + vec2(-halfTexel.x, halfTexel.y)).rgb * 2.0;
+	sum += texture(sourceTexture, TexCoords + vec2(0.0, halfTexel.y * 2.0)).rgb;
+	sum += texture(sourceTexture, TexCoords + vec2(halfTexel.x, halfTexel.y)).rgb * 2.0;
+	sum += texture(sourceTexture, TexCoords + vec2(halfTexel.x * 2.0, 0.0)).rgb;
+	sum += texture(sourceTexture, TexCoords + vec2(halfTexel.x, -halfTexel.y)).rgb * 2.0;
+	sum += texture(sourceTexture, TexCoords + vec2(0.0, -halfTexel.y * 2.0)).rgb;
+	sum += texture(sourceTexture, TexCoords + vec2(-halfTexel.x, -halfTexel.y)).rgb * 2.0;
+	FragColor = vec4(sum / 12.0, 1.0);
+}
+
+#endif
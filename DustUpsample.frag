@@ -0,0 +1,36 @@
+#version 430 core
+out vec4 FragColor;
+in vec2 TexCoords;
+
+// dust accumulated at a fraction of the screen resolution, rgb and coverage summed up
+uniform sampler2D dustBuffer;
+uniform vec2 dustTexelSize;
+// how strongly texels whose coverage differs from the local average are rejected
+uniform float edgeSharpness;
+
+// Joint bilateral upsample guided by the dust coverage: the four nearest low resolution
+// texels are weighted bilinearly and by how close their coverage is to the bilinear
+// coverage here, so the bright core of a sprite does not bleed over its edge.
+void main()
+{
+	vec2 texelPos = TexCoords / dustTexelSize - 0.5;
+	vec2 base = floor(texelPos);
+	vec2 fraction = texelPos - base;
+	float guide = texture(dustBuffer, TexCoords).a;
+
+	vec4 sum = vec4(0.0);
+	float weightSum = 0.0;
+	for(int y = 0; y < 2; ++y)
+	{
+		for(int x = 0; x < 2; ++x)
+		{
+			vec4 dust = texture(dustBuffer, (base + vec2(x, y) + 0.5) * dustTexelSize);
+			vec2 bilinear = mix(1.0 - fraction, fraction, vec2(x, y));
+			float weight = bilinear.x * bilinear.y * exp(-abs(dust.a - guide) * edgeSharpness) + 1e-4;
+			sum += dust * weight;
+			weightSum += weight;
+		}
+	}
+
+	FragColor = sum / weightSum;
+}
@@ -0,0 +1,63 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec3 LocalPos;
+flat in vec3 RayOrigin;
+flat in vec3 Tint;
+
+uniform sampler3D dustVolume;
+uniform sampler3D occupancy;
+uniform vec3 volumeMin;
+uniform vec3 volumeMax;
+// turns a splatted sum times a local step length into the light the billboards would add
+uniform float emissionScale;
+
+const int OCCUPANCY_CELL = 8;
+const int MAX_STEPS = 1024;
+
+// entry and exit distances of a ray through an axis aligned box
+vec2 intersectBox(vec3 origin, vec3 inverseDir, vec3 boxMin, vec3 boxMax)
+{
+	vec3 t0 = (boxMin - origin) * inverseDir;
+	vec3 t1 = (boxMax - origin) * inverseDir;
+	vec3 tNear = min(t0, t1);
+	vec3 tFar = max(t0, t1);
+	return vec2(max(max(tNear.x, tNear.y), tNear.z), min(min(tFar.x, tFar.y), tFar.z));
+}
+
+// Emission only ray march, matching additive billboards. Blocks of the occupancy grid
+// without dust are crossed in one jump to their exit.
+void main()
+{
+	vec3 dir = normalize(LocalPos - RayOrigin);
+	vec3 inverseDir = 1.0 / mix(dir, vec3(1e-6), equal(dir, vec3(0.0)));
+
+	vec2 range = intersectBox(RayOrigin, inverseDir, volumeMin, volumeMax);
+	float t = max(range.x, 0.0);
+
+	vec3 gridSize = vec3(textureSize(dustVolume, 0));
+	vec3 cellSize = (volumeMax - volumeMin) / gridSize;
+	vec3 blockSize = cellSize * float(OCCUPANCY_CELL);
+	ivec3 blockCount = textureSize(occupancy, 0);
+	float stepLength = 0.5 * min(cellSize.x, min(cellSize.y, cellSize.z));
+
+	vec3 radiance = vec3(0.0);
+	for(int i = 0; i < MAX_STEPS && t < range.y; ++i)
+	{
+		vec3 position = RayOrigin + dir * t;
+		vec3 uvw = (position - volumeMin) / (volumeMax - volumeMin);
+		ivec3 block = clamp(ivec3(uvw * vec3(blockCount)), ivec3(0), blockCount - 1);
+
+		if(texelFetch(occupancy, block, 0).r == 0.0)
+		{
+			vec3 blockMin = volumeMin + vec3(block) * blockSize;
+			t = max(intersectBox(RayOrigin, inverseDir, blockMin, blockMin + blockSize).y, t) + 1e-3 * stepLength;
+			continue;
+		}
+
+		radiance += texture(dustVolume, uvw).rgb * stepLength;
+		t += stepLength;
+	}
+
+	FragColor = vec4(radiance * emissionScale * Tint, 0.0);
+}
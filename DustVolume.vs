@@ -0,0 +1,48 @@
+#version 430 core
+// The bounding box of the dust volume, one instance per galaxy. Instances of galaxies
+// built from another template are moved out of the clip volume.
+
+#include "Galaxy.glsl"
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+uniform vec3 camPos;
+uniform uint templateIndex;
+uniform vec3 volumeMin;
+uniform vec3 volumeMax;
+
+// both in the template's local space, where the volume was splatted
+out vec3 LocalPos;
+flat out vec3 RayOrigin;
+flat out vec3 Tint;
+
+// corner i has x = bit 0, y = bit 1, z = bit 2, counter clockwise seen from outside
+const int cubeIndices[36] = int[36](
+	4, 6, 2, 4, 2, 0,
+	3, 7, 5, 3, 5, 1,
+	1, 5, 4, 1, 4, 0,
+	6, 7, 3, 6, 3, 2,
+	2, 3, 1, 2, 1, 0,
+	5, 7, 6, 5, 6, 4);
+
+void main()
+{
+	Galaxy galaxy = galaxies[gl_InstanceID];
+	if(galaxy.particleBase / NUM_PARTICLES != templateIndex)
+	{
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+
+	int corner = cubeIndices[gl_VertexID];
+	LocalPos = mix(volumeMin, volumeMax, vec3(corner & 1, (corner >> 1) & 1, corner >> 2));
+
+	// same chain as the particles: galaxy transform of the scaled, model transformed position
+	float scale = dustScale * galaxy.scale;
+	mat4 localToWorld = galaxy.model * mat4(scale, 0.0, 0.0, 0.0, 0.0, scale, 0.0, 0.0, 0.0, 0.0, scale, 0.0, 0.0, 0.0, 0.0, 1.0) * model;
+	RayOrigin = vec3(inverse(localToWorld) * vec4(camPos, 1.0));
+	Tint = galaxy.tint.rgb;
+
+	gl_Position = projection * view * localToWorld * vec4(LocalPos, 1.0);
+}
@@ -0,0 +1,27 @@
+// The drawn galaxies and the per particle class sizes, shared by the passes that place
+// particles in the world.
+#include "Particle.glsl"
+
+layout(std430, binding = 6) readonly buffer Galaxies
+{
+	Galaxy galaxies[];
+};
+
+layout(std140, binding = 5) uniform Parameters {
+	RENDER_PARAMETERS
+};
+
+// H2 regions shrink as the arm they sit on shears them apart
+float particleScale(Particle particle, uint particleType, float t)
+{
+	if(particleType == STAR)
+		return starScale;
+	if(particleType == DUST)
+		return dustScale;
+
+	Particle h2Particle = particle;
+	h2Particle.pos.x += h2Distance;
+
+	float delta = distance(calcPosition(h2Particle, t), calcPosition(particle, t));
+	return h2Size * (1.0 - ease_in_circ(delta / h2Distance));
+}
@@ -1,36 +1,98 @@
 #version 430 core
-out vec4 FragColor;
-in vec2 TexCoords;
-in vec3 WorldPos;
-in vec3 Normal;
+#if defined(OIT_PASS)
+layout (location = 0) out vec4 Accum;
+layout (location = 1) out float Revealage;
+#else
+layout (location = 0) out vec4 FragColor;
+#endif
+
+// with OIT or sorted blending dust absorbs with this opacity, its color is scaled
+// down so it emits as much light as in additive mode
+layout (location = 12) uniform float dustOpacity;
+
+layout (location = 0) in vec2 TexCoords;
+layout (location = 1) in vec3 WorldPos;
+layout (location = 2) in vec3 Normal;
 
 const float PI = 3.14159265359;
 
-in vec4 Color;
-in flat uint ParticleType;
+layout (location = 3) in vec4 Color;
+
+// star PSF, dust puff and H2 nebula, one layer per particle type, on SPRITE_TEXTURE_UNIT
+layout (binding = 7) uniform sampler2DArray spriteTexture;
+#if defined(POINT_SPRITE)
+layout (location = 4) in float Coverage;
+// the sprite averaged over the disk Coverage stands for, see SpriteArray::diskAverage
+layout (location = 13) uniform vec4 spriteAverage;
+#endif
+
+// H2 regions do not take their alpha from Color, so they get the governor's compensation here
+layout (location = 8) uniform float brightnessScale;
+
+const uint STAR = 0u;
+const uint DUST = 1u;
+const uint H2 = 2u;
+
+#if defined(SORTED_PASS)
+layout (location = 5) flat in uint ParticleType;
+#define PARTICLE_TYPE ParticleType
+#elif defined(STAR_PASS)
+#define PARTICLE_TYPE STAR
+#elif defined(DUST_PASS)
+#define PARTICLE_TYPE DUST
+#else
+#define PARTICLE_TYPE H2
+#endif
+
+#if defined(OVERDRAW)
+// fragments per pixel, one layer per particle type
+layout(r32ui, binding = 5) uniform uimage2DArray overdrawCounts;
+#endif
 
 void main()
 {
-	vec2 centeredPos = 2.0 * (TexCoords - 0.5);
+#if defined(OVERDRAW)
+	imageAtomicAdd(overdrawCounts, ivec3(gl_FragCoord.xy, PARTICLE_TYPE), 1u);
+#endif
+
 	vec4 color  = Color;
 
-	if(ParticleType == 1)
-	{
-		//if(dot(centeredPos, centeredPos) > 1.0)
-			//discard;
-	}
-	else if(ParticleType == 0)
-	{
-		color.rgb *= vec3(0.5, 0.5, 1.0);
-		color.a *= max(1.0 - length(centeredPos), 0.0);
-	}
+#if defined(POINT_SPRITE)
+	// a single pixel stands for the whole sprite
+	vec4 sprite = spriteAverage;
+#else
+	vec4 sprite = texture(spriteTexture, vec3(TexCoords, float(PARTICLE_TYPE)));
+#endif
+
+	// H2 regions take their whole look from the sprite, the others are modulated by it
+	if(PARTICLE_TYPE == H2)
+		color = vec4(sprite.rgb, sprite.a * brightnessScale);
 	else
-	{
-		float dist = max(1.0 - length(centeredPos), 0.0);
+		color *= sprite;
 
-		color.rgb = mix(vec3(1.0, 0.0, 0.0), vec3(1.0), dist * dist * dist);
-		color.a = dist * dist;
+#if defined(POINT_SPRITE)
+	color.a *= Coverage;
+#endif
+
+#if defined(OIT_PASS) || defined(SORTED_PASS)
+	if(PARTICLE_TYPE == DUST)
+	{
+		float opacity = color.a / max(Color.a, 1e-6) * dustOpacity;
+		color.rgb *= color.a / max(opacity, 1e-6);
+		color.a = opacity;
 	}
+#endif
 
+#if defined(OIT_PASS)
+	// weighted blended OIT (McGuire and Bavoil, eq. 10), distances scaled to galaxy units
+	float viewDepth = (1.0 / gl_FragCoord.w) / 10000.0;
+	float weight = color.a * clamp(10.0 / (1e-5 + pow(viewDepth / 5.0, 2.0) + pow(viewDepth / 200.0, 6.0)), 1e-2, 3e3);
+	Accum = vec4(color.rgb * color.a, color.a) * weight;
+	Revealage = color.a;
+#elif defined(SORTED_PASS)
+	// premultiplied, composited back to front with the over operator
+	FragColor = vec4(color.rgb * color.a, color.a);
+#else
 	FragColor = color;
+#endif
 }
\ No newline at end of file
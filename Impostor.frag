@@ -0,0 +1,13 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+flat in uint Layer;
+
+// additive radiance captured per galaxy, one layer each
+uniform sampler2DArray impostorTexture;
+
+void main()
+{
+	FragColor = texture(impostorTexture, vec3(TexCoords, float(Layer)));
+}
@@ -0,0 +1,30 @@
+#version 430 core
+// One camera facing quad per impostored galaxy, sized like the capture frustum at the galaxy center.
+
+#include "Layouts.glsl"
+
+layout(std430, binding = 13) readonly buffer ImpostorQuads
+{
+	ImpostorQuad impostors[];
+};
+
+uniform mat4 projection;
+uniform mat4 view;
+
+out vec2 TexCoords;
+flat out uint Layer;
+
+void main()
+{
+	ImpostorQuad impostor = impostors[gl_InstanceID];
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+	// the rows of the view rotation are the camera axes in world space
+	vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+	vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+	vec3 position = impostor.centerHalfSize.xyz + (right * (corner.x * 2.0 - 1.0) + up * (corner.y * 2.0 - 1.0)) * impostor.centerHalfSize.w;
+
+	TexCoords = corner;
+	Layer = impostor.layer.x;
+	gl_Position = projection * view * vec4(position, 1.0);
+}
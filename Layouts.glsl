@@ -0,0 +1,118 @@
+// The buffer contents shared by the shaders and the host. galaxy_render.cpp includes this
+// file as C++ (inside namespace gpu, with the GLSL type names mapped to glm), so it may only
+// hold what both languages accept: structs, constants, plain functions and #defines. The C++
+// side static_asserts the offsets and strides below, keep them in sync when a member changes.
+//
+// Members are ordered so the std430 / std140 rules add no padding the C++ compiler would
+// not add as well: no vec3, and every vec4 / mat4 on a 16 byte boundary.
+
+// One generated particle, 32 bytes in the std430 Particles buffer. The orbit lies in its own
+// plane, so pos only needs two components; calcPosition adds the height.
+struct Particle
+{
+	vec2 pos;
+	float rotation;
+	float angle;
+	float height;
+	float angleVel;
+	float brightness;
+	float temp;
+};
+
+// The same particle in 16 bytes, used instead of Particle when the host defines
+// PACKED_PARTICLES. The angles only matter modulo a turn, so they are stored as 16 bit
+// fractions of one (1e-4 radians); the rest fits half floats, whose 11 bit mantissa keeps
+// a position at the rim within half a unit, far below the size of a star sprite.
+//  x: pos
+//  y: angle and rotation, unorm16 turns
+//  z: height and angleVel, halves
+//  w: brightness and temp, halves
+struct PackedParticle
+{
+	uvec4 words;
+};
+
+const float TURN = 6.28318530718f;
+
+PackedParticle packParticle(Particle particle)
+{
+	PackedParticle record;
+	record.words = uvec4(packHalf2x16(particle.pos),
+		packUnorm2x16(fract(vec2(particle.angle, particle.rotation) / TURN)),
+		packHalf2x16(vec2(particle.height, particle.angleVel)),
+		packHalf2x16(vec2(particle.brightness, particle.temp)));
+	return record;
+}
+
+Particle unpackParticle(PackedParticle record)
+{
+	vec2 turns = unpackUnorm2x16(record.words.y) * TURN;
+	vec2 heightVelocity = unpackHalf2x16(record.words.z);
+	vec2 brightnessTemp = unpackHalf2x16(record.words.w);
+
+	Particle particle;
+	particle.pos = unpackHalf2x16(record.words.x);
+	particle.angle = turns.x;
+	particle.rotation = turns.y;
+	particle.height = heightVelocity.x;
+	particle.angleVel = heightVelocity.y;
+	particle.brightness = brightnessTemp.x;
+	particle.temp = brightnessTemp.y;
+	return particle;
+}
+
+// one entry per drawn galaxy, particleBase selects the particle template it reuses
+struct Galaxy
+{
+	mat4 model;
+	vec4 tint;
+	float scale;
+	float timeOffset;
+	uint particleBase;
+	float padding;
+};
+
+// the layout glDrawElementsIndirect reads, ParticleClassify.comp fills the sphere draws
+struct DrawElementsCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+struct ImpostorQuad
+{
+	// xyz world center, w half size of the quad
+	vec4 centerHalfSize;
+	// x layer in the impostor array
+	uvec4 layer;
+};
+
+// The members of the std140 uniform blocks. Blocks cannot be declared in C++, so they are
+// spelled out once here and expanded into the GLSL block and the C++ struct.
+#define GENERATOR_PARAMETERS \
+	float inExc; \
+	float outExc; \
+	float offset; \
+	float maxRad; \
+	float core; \
+	float inExcDiv; \
+	float outExcDiv; \
+	float bugleRad; \
+	float speed; \
+	float maxStarBrightness; \
+	float minStarBrightness; \
+	float maxDustBrightness; \
+	float minDustBrightness; \
+	float maxTemp; \
+	float minTemp;
+
+#define RENDER_PARAMETERS \
+	float starScale; \
+	float dustScale; \
+	float h2Size; \
+	float h2Distance; \
+	float blackbodyMinTemp; \
+	float blackbodyMaxTemp;
@@ -0,0 +1,16 @@
+#version 430 core
+out vec4 FragColor;
+in vec2 TexCoords;
+
+uniform sampler2D accumTexture;
+uniform sampler2D revealageTexture;
+
+void main()
+{
+	vec4 accum = texture(accumTexture, TexCoords);
+	float revealage = texture(revealageTexture, TexCoords).r;
+
+	// weighted average color of every fragment, blended over the background by 1 - revealage
+	vec3 averageColor = accum.rgb / max(accum.a, 1e-5);
+	FragColor = vec4(averageColor, 1.0 - revealage);
+}
@@ -0,0 +1,33 @@
+#version 430 core
+out vec4 FragColor;
+in vec2 TexCoords;
+
+// fragments per pixel, one layer per particle type
+uniform usampler2DArray overdrawCounts;
+// count shown at the top of the color ramp, the ramp is logarithmic below it
+uniform float maxOverdraw;
+
+vec3 heat(float t)
+{
+	const vec3 ramp[6] = vec3[6](
+		vec3(0.0, 0.0, 0.0),
+		vec3(0.0, 0.0, 1.0),
+		vec3(0.0, 1.0, 0.0),
+		vec3(1.0, 1.0, 0.0),
+		vec3(1.0, 0.0, 0.0),
+		vec3(1.0, 1.0, 1.0));
+
+	float position = clamp(t, 0.0, 1.0) * 5.0;
+	int index = min(int(position), 4);
+	return mix(ramp[index], ramp[index + 1], position - float(index));
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	uint total = 0u;
+	for(int type = 0; type < 3; ++type)
+		total += texelFetch(overdrawCounts, ivec3(pixel, type), 0).r;
+
+	FragColor = vec4(heat(log2(1.0 + float(total)) / log2(1.0 + maxOverdraw)), 1.0);
+}
@@ -0,0 +1,71 @@
+// The particle templates, shared by the generator and every pass that reads them.
+// NUM_STARS, NUM_DUST, NUM_H2, NUM_PARTICLES, H2_RATIO and PACKED_PARTICLES are injected by
+// the host (Shader::globalDefines), so the class ranges below fold into constants.
+// Each template is NUM_PARTICLES particles: the stars, then the dust, then the H2 regions.
+
+#if defined(GL_SPIRV)
+// precompiled stages get the same values as specialization constants, see Shader::enableSpirv
+layout(constant_id = 0) const uint NUM_STARS = 1u;
+layout(constant_id = 1) const uint NUM_DUST = 1u;
+layout(constant_id = 2) const uint NUM_H2 = 1u;
+layout(constant_id = 3) const uint NUM_PARTICLES = 3u;
+layout(constant_id = 4) const uint H2_RATIO = 1u;
+#endif
+
+#include "Layouts.glsl"
+
+// the record format is chosen by the host, every access goes through these two
+#if defined(PACKED_PARTICLES)
+layout(std430, binding = 4) buffer Particles
+{
+	PackedParticle particles[];
+};
+
+Particle loadParticle(uint index)
+{
+	return unpackParticle(particles[index]);
+}
+
+void storeParticle(uint index, Particle particle)
+{
+	particles[index] = packParticle(particle);
+}
+#else
+layout(std430, binding = 4) buffer Particles
+{
+	Particle particles[];
+};
+
+Particle loadParticle(uint index)
+{
+	return particles[index];
+}
+
+void storeParticle(uint index, Particle particle)
+{
+	particles[index] = particle;
+}
+#endif
+
+const uint STAR = 0u;
+const uint DUST = 1u;
+const uint H2 = 2u;
+
+uint particleTypeOf(uint particleIndex)
+{
+	return particleIndex < NUM_STARS ? STAR : (particleIndex < NUM_STARS + NUM_DUST ? DUST : H2);
+}
+
+float ease_in_circ(float x)
+{
+	return x >= 1.0 ? 1.0 : 1.0 - sqrt(1.0 - x * x);
+}
+
+vec3 calcPosition(Particle particle, float t){
+	vec3 calculatedPosition;
+	float angle = particle.angle + particle.angleVel * t;
+	calculatedPosition.x = particle.pos.x * cos(angle) * cos(particle.rotation) - particle.pos.y * sin(angle) * sin(particle.rotation);
+	calculatedPosition.y = particle.height;
+	calculatedPosition.z = particle.pos.x * cos(angle) * sin(particle.rotation) + particle.pos.y * sin(angle) * cos(particle.rotation);
+	return calculatedPosition;
+}
@@ -0,0 +1,35 @@
+// Park-Miller generator with Schrage's factorization (ran0 in Numerical Recipes), the same
+// sequence as myRand() on the CPU. One state per invocation, seed it with srand_set() first.
+
+#define RANDOM_IA 16807
+#define RANDOM_IM 2147483647
+#define RANDOM_AM 1.0 / float(RANDOM_IM)
+#define RANDOM_IQ 127773
+#define RANDOM_IR 2836
+#define RANDOM_MASK 123459876
+
+int _SEED = 0;
+
+void srand_cycle()
+{
+	_SEED ^= RANDOM_MASK;
+	int k = _SEED / RANDOM_IQ;
+	_SEED = RANDOM_IA * (_SEED - k * RANDOM_IQ) - RANDOM_IR * k;
+
+	if (_SEED < 0)
+		_SEED += RANDOM_IM;
+
+	_SEED ^= RANDOM_MASK;
+}
+
+void srand_set(int seed)
+{
+	_SEED = seed;
+	srand_cycle();
+}
+
+float rand()
+{
+	srand_cycle();
+	return RANDOM_AM * _SEED;
+}
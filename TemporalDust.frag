@@ -0,0 +1,49 @@
+#version 430 core
+// Adds the last TEMPORAL_SUBSETS dust slices onto the HDR target. Each slice holds one dust
+// subset at its plain brightness, drawn from the camera of its own frame, and is reprojected
+// from there through the dust plane.
+out vec4 FragColor;
+in vec2 TexCoords;
+
+// TEMPORAL_SUBSETS in galaxy_render.cpp
+const int SLICE_COUNT = 4;
+
+uniform sampler2D sliceTextures[SLICE_COUNT];
+uniform mat4 sliceViewProjections[SLICE_COUNT];
+// bit i is set when slice i holds a subset
+uniform uint validSlices;
+uniform mat4 inverseViewProjection;
+uniform vec3 camPos;
+// height of the dust plane in world space, the surface the slices are reprojected through
+uniform float planeHeight;
+
+void main()
+{
+	vec4 farPoint = inverseViewProjection * vec4(TexCoords * 2.0 - 1.0, 1.0, 1.0);
+	vec3 dir = normalize(farPoint.xyz / farPoint.w - camPos);
+
+	// rays that miss the plane only see the camera rotation, as if the dust were far away
+	float t = (planeHeight - camPos.y) / dir.y;
+	if(abs(dir.y) < 1e-4 || t < 0.0)
+		t = 1e5;
+	vec4 planePoint = vec4(camPos + dir * t, 1.0);
+
+	vec4 sum = vec4(0.0);
+	int found = 0;
+	for(int i = 0; i < SLICE_COUNT; ++i)
+	{
+		if((validSlices & (1u << uint(i))) == 0u)
+			continue;
+
+		vec4 slice = sliceViewProjections[i] * planePoint;
+		vec2 sliceUV = slice.xy / slice.w * 0.5 + 0.5;
+		if(slice.w <= 0.0 || any(lessThan(sliceUV, vec2(0.0))) || any(greaterThan(sliceUV, vec2(1.0))))
+			continue;
+
+		sum += texture(sliceTextures[i], sliceUV);
+		++found;
+	}
+
+	// every slice is one subset, the ones missing here stand in for the same share of the dust
+	FragColor = found > 0 ? sum * (float(SLICE_COUNT) / float(found)) : vec4(0.0);
+}
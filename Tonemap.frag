@@ -0,0 +1,18 @@
+#version 430 core
+out vec4 FragColor;
+in vec2 TexCoords;
+
+uniform sampler2D hdrBuffer;
+uniform sampler2D bloomBuffer;
+uniform float exposure;
+// 0 when bloom is off
+uniform float bloomIntensity;
+
+void main()
+{
+	vec3 hdrColor = texture(hdrBuffer, TexCoords).rgb;
+	hdrColor += texture(bloomBuffer, TexCoords).rgb * bloomIntensity;
+
+	// exponential exposure curve, keeps the bulge from clipping while faint dust stays visible
+	FragColor = vec4(vec3(1.0) - exp(-hdrColor * exposure), 1.0);
+}
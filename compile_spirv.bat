@@ -0,0 +1,52 @@
+@echo off
+rem Precompiles the shaders loaded through ARB_gl_spirv into spirv\, see Shader::enableSpirv:
+rem particleProcessor.comp and both GalaxyShader stages of every variant in shader_variants.txt,
+rem for both particle record formats.
+rem Without glslangValidator (Vulkan SDK) nothing is built and the app compiles the sources.
+setlocal EnableDelayedExpansion
+cd /d "%~dp0"
+
+set GLSLANG=glslangValidator
+if defined VULKAN_SDK set GLSLANG="%VULKAN_SDK%\Bin\glslangValidator.exe"
+%GLSLANG% --version >nul 2>&1
+if errorlevel 1 (
+    echo compile_spirv: glslangValidator not found, the shaders will be compiled from source
+    exit /b 0
+)
+
+if not exist spirv mkdir spirv
+set FAILED=0
+
+rem once per particle record format, --packed-particles picks one at startup
+call :compile_all "" ""
+call :compile_all "-DPACKED_PARTICLES" ".PACKED_PARTICLES"
+exit /b %FAILED%
+
+rem global defines, their file name suffix
+:compile_all
+call :compile comp particleProcessor.comp "%~1" particleProcessor.comp%~2
+
+rem the file names carry the defines in manifest order, then the global ones,
+rem the order Shader::spirvPath expects
+for /f "usebackq eol=# tokens=*" %%L in ("shader_variants.txt") do (
+    set FLAGS=
+    set SUFFIX=
+    for %%W in (%%L) do (
+        set FLAGS=!FLAGS! -D%%W
+        set SUFFIX=!SUFFIX!.%%W
+    )
+    call :compile vert GalaxyShader.vs "!FLAGS! %~1" GalaxyShader.vs!SUFFIX!%~2
+    call :compile frag GalaxyShader.frag "!FLAGS! %~1" GalaxyShader.frag!SUFFIX!%~2
+)
+exit /b 0
+
+rem stage, source, defines, output name
+:compile
+%GLSLANG% -G -S %1 %~3 -o spirv\%4.spv %2 >nul
+if errorlevel 1 (
+    echo compile_spirv: %4 failed
+    %GLSLANG% -G -S %1 %~3 %2
+    if exist spirv\%4.spv del spirv\%4.spv
+    set FAILED=1
+)
+exit /b 0
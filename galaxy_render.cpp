@@ -8,7 +8,18 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 #include <UtilLibary/Camera.h>
+#include <UtilLibary/GpuTimer.h>
+#include <UtilLibary/RenderTarget.h>
+#include <UtilLibary/RadixSort.h>
+#include <UtilLibary/SpriteArray.h>
+#include <UtilLibary/Blackbody.h>
+#include <UtilLibary/ShaderReloader.h>
+#include <UtilLibary/ShaderVariants.h>
+#include <chrono>
+#include <cstddef>
+#include <vector>
 
 
 
@@ -20,6 +31,20 @@
 #define RANDOM_MASK 123459876
 const int NUMBER_PARTICLE = 100000;
 const int NUMBER_STAR = 80000;
+// every H2_RATIO-th dust particle is an H2 region
+const int H2_RATIO = 150;
+const int NUMBER_H2 = (NUMBER_PARTICLE + H2_RATIO - 1) / H2_RATIO - (NUMBER_STAR + H2_RATIO - 1) / H2_RATIO;
+const int NUMBER_DUST = NUMBER_PARTICLE - NUMBER_STAR - NUMBER_H2;
+// particle sets generated once and shared by every galaxy in the scene
+const int NUMBER_TEMPLATE = 4;
+// threads per group of particleProcessor.comp, NUMBER_PARTICLE has to be a multiple of it
+const int PARTICLE_WORKGROUP_SIZE = 250;
+// Store the particles as the 16 byte PackedParticle of Layouts.glsl instead of the 32 byte
+// Particle: half the memory traffic of every pass that reads them for slightly coarser values.
+// Off unless the program is started with --packed-particles.
+bool packedParticles = false;
+const int MAX_GALAXIES = 256;
+const float CLUSTER_RADIUS = 60000.0f;
 const float PI = 3.14159265359f;
 
 int _SEED = 0;
@@ -53,41 +78,83 @@ float ease_in_exp(float x)
     return x <= 0.0 ? 0.0 : pow(2, 10.0 * x - 10.0);
 }
 
-struct Particle {
-    glm::vec3 pos;
-    float rotation;
-    float angle;
-    float height;
-    float angleVel;
-    float brightness;
-    float temp;
-};
+// Layouts.glsl declares the buffer contents for both sides, these give its GLSL type names
+// and built-in functions a C++ meaning
+namespace gpu {
+typedef glm::vec2 vec2;
+typedef glm::vec4 vec4;
+typedef glm::uvec4 uvec4;
+typedef glm::mat4 mat4;
+typedef unsigned int uint;
+using glm::fract;
+using glm::packHalf2x16;
+using glm::unpackHalf2x16;
+using glm::packUnorm2x16;
+using glm::unpackUnorm2x16;
+
+#include "Layouts.glsl"
+}
+
+typedef gpu::Particle Particle;
+typedef gpu::PackedParticle PackedParticle;
+typedef gpu::Galaxy GalaxyInstance;
+typedef gpu::ImpostorQuad ImpostorQuad;
+typedef gpu::DrawElementsCommand DrawElementsIndirectCommand;
 
 struct ComputeParameters {
+    GENERATOR_PARAMETERS
+};
+
+struct VertexParams {
+    RENDER_PARAMETERS
+};
+
+// Offsets and sizes as the GLSL packing rules place them: std430 for the Particles,
+// Galaxies, SphereDraws and ImpostorQuads arrays, std140 for the two uniform blocks. A C++ struct that
+// drifts from these would upload into the wrong members.
+static_assert(sizeof(Particle) == 32, "Particle stride differs from std430");
+static_assert(offsetof(Particle, rotation) == 8, "Particle::rotation offset differs from std430");
+static_assert(offsetof(Particle, temp) == 28, "Particle::temp offset differs from std430");
+
+static_assert(sizeof(PackedParticle) == 16, "PackedParticle stride differs from std430");
+
+static_assert(sizeof(GalaxyInstance) == 96, "Galaxy stride differs from std430");
+static_assert(offsetof(GalaxyInstance, tint) == 64, "Galaxy::tint offset differs from std430");
+static_assert(offsetof(GalaxyInstance, scale) == 80, "Galaxy::scale offset differs from std430");
+static_assert(offsetof(GalaxyInstance, particleBase) == 88, "Galaxy::particleBase offset differs from std430");
+
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsCommand stride differs from std430");
+static_assert(offsetof(DrawElementsIndirectCommand, instanceCount) == 4, "DrawElementsCommand::instanceCount offset differs from std430");
+
+static_assert(sizeof(ImpostorQuad) == 32, "ImpostorQuad stride differs from std430");
+static_assert(offsetof(ImpostorQuad, layer) == 16, "ImpostorQuad::layer offset differs from std430");
+
+static_assert(sizeof(ComputeParameters) == 60, "generator Parameters size differs from std140");
+static_assert(offsetof(ComputeParameters, minTemp) == 56, "generator Parameters::minTemp offset differs from std140");
+
+static_assert(sizeof(VertexParams) == 24, "render Parameters size differs from std140");
+static_assert(offsetof(VertexParams, blackbodyMaxTemp) == 20, "render Parameters::blackbodyMaxTemp offset differs from std140");
+
+struct DrawArraysIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+// shape tweaks applied on top of the base ComputeParameters, template 0 is the original galaxy
+struct TemplateShape {
+    float offset;
     float inExc;
     float outExc;
-    float offset;
-    float maxRad;
-    float core;
-    float inExcDiv;
-    float outExcDiv;
-    float bugleRad;
     float speed;
-    unsigned int numStarts;
-    float maxStarBrightness;
-    float minStarBrightness;
-    float maxDustBrightness;
-    float minDustBrightness;
-    float maxTemp;
-    float minTemp;
 };
 
-struct VertexParams {
-    float starScale;
-    float dustScale;
-    unsigned int numStarts;
-    float h2Size;
-    float h2Distance;
+const TemplateShape templateShapes[NUMBER_TEMPLATE] = {
+    { 4.5f, 0.25f, 0.20f, 7.0f },
+    { 3.0f, 0.35f, 0.15f, 6.0f },
+    { 6.0f, 0.20f, 0.30f, 8.0f },
+    { 2.0f, 0.45f, 0.25f, 5.0f },
 };
 
 using namespace std;
@@ -103,24 +170,372 @@ WindowsUtil* windowUtil = new WindowsUtil();
 
 float deltaTime = 0.0f;	// Time between current frame and last frame
 float lastFrame = 0.0f; // Time of last frame
-bool close = false;
+bool closeRequested = false;
 
 using namespace glm;
 
 unsigned int sphereVAO;
 unsigned int indexCount;
 
-Shader* galaxyShader;
 Shader* computeShader;
+ShaderReloader* shaderReloader;
+
+// Each particle pass has one program per combination of these bits, built when first drawn
+// unless shader_variants.txt lists it. Particles smaller than a pixel skip the sphere and go
+// through the point variant instead.
+enum ParticleVariant {
+    pointVariant = 1,
+    oitVariant = 2,
+    overdrawVariant = 4
+};
+
+// the define of each ParticleVariant bit, in bit order
+const vector<string> variantFeatures = { "POINT_SPRITE", "OIT_PASS", "OVERDRAW" };
+
+// The compute pass stores stars, dust and H2 regions in three contiguous ranges
+// (in that order), each one drawn by programs compiled only with its own path.
+struct ParticlePass {
+    ShaderVariants* programs;
+    // the define selecting this class' path in the shaders
+    const char* name;
+    unsigned int firstParticle;
+    unsigned int particleCount;
+    // prefix of the range actually drawn this frame, set by the frame governor
+    unsigned int drawCount;
+    // part of that prefix drawn by this frame's commands, smaller than it when
+    // temporal accumulation spreads the pass over several frames
+    unsigned int drawFirst;
+    unsigned int drawInstances;
+    unsigned int vao;
+    unsigned int indexCount;
+    GLenum primitive;
+};
+
+enum ParticleType {
+    starParticle,
+    dustParticle,
+    h2Particle,
+    particleTypeCount
+};
+
+ParticlePass particlePasses[particleTypeCount] = {
+    { NULL, "STAR_PASS", 0, NUMBER_STAR, NUMBER_STAR },
+    { NULL, "DUST_PASS", NUMBER_STAR, NUMBER_DUST, NUMBER_DUST },
+    { NULL, "H2_PASS", NUMBER_STAR + NUMBER_DUST, NUMBER_H2, NUMBER_H2 },
+};
+
+// point path for sub-pixel particles, the threshold is the projected diameter in pixels
+unsigned int pointVAO;
+bool pointSplatting = true;
+float pointThreshold = 1.5f;
+
+// Every galaxy is one command in each pass' multi-draw. The galaxy ID reaches the vertex
+// shader through an instanced attribute whose divisor is never reached, so each command
+// reads the element at its baseInstance, which is set to the galaxy index.
+const GLuint GALAXY_ID_DIVISOR = 0x7fffffff;
+vector<GalaxyInstance> galaxies;
+unsigned int galaxySsbo;
+unsigned int galaxyIdBuffer;
+// the point commands, one per galaxy and pass
+unsigned int drawCommandBuffer;
+// indices of the galaxies drawn from their particles, the classifier walks these
+unsigned int drawnGalaxyBuffer;
+GLuint drawnGalaxyCount = 0;
+bool clusterView = false;
+
+// Before every particle draw ParticleClassify.comp lists, for every galaxy, the particles of
+// each pass that project to at least pointThreshold pixels, and counts them into the pass'
+// listed sphere draw. Only those pay for the sphere mesh; the point pass walks every range
+// with one vertex per particle and drops the big ones. The list mirrors the particle buffer,
+// a pass owns NUMBER_TEMPLATE times its range, so its size follows the templates and not
+// the galaxies. It holds every sphere of NUMBER_TEMPLATE close galaxies. A galaxy whose
+// spheres do not fit is drawn by its own fallback command, over its whole range.
+const GLuint CLASSIFY_GROUP_SIZE = 256;
+// per pass the listed draw, then one fallback draw per galaxy
+const GLuint SPHERE_DRAWS_PER_PASS = MAX_GALAXIES + 1;
+Shader* classifyShader;
+unsigned int sphereListBuffer;
+unsigned int sphereDrawBuffer;
+unsigned int sphereReservationBuffer;
+// the sphere draws every classification starts from, all empty
+vector<DrawElementsIndirectCommand> emptySphereDraws;
+
+// Scales the drawn prefix of every particle range so the GPU frame time stays near the target.
+// Particle ids are generated independently, so any prefix is a representative subsample and
+// the dropped light is given back to the drawn particles through brightnessScale.
+struct FrameGovernor {
+    bool enabled = false;
+    float targetMs = 1000.0f / 60.0f;
+    // no adjustment while the smoothed time is within this fraction of the target
+    float hysteresis = 0.1f;
+    float minBudget = 0.02f;
+    float budget = 1.0f;
+    float smoothedMs = 0.0f;
+
+    void update(float frameMs) {
+        smoothedMs = smoothedMs == 0.0f ? frameMs : glm::mix(smoothedMs, frameMs, 0.1f);
+        if (!enabled) {
+            budget = 1.0f;
+            return;
+        }
+
+        if (smoothedMs > targetMs * (1.0f + hysteresis)) {
+            // cost is roughly linear in the particle count, but never drop more than 20% at once
+            budget *= glm::max(targetMs / smoothedMs, 0.8f);
+        }
+        else if (smoothedMs < targetMs * (1.0f - hysteresis)) {
+            budget *= 1.05f;
+        }
+        budget = glm::clamp(budget, minBudget, 1.0f);
+    }
+};
+
+FrameGovernor governor;
+GpuTimer* frameTimer;
+
+// Render on demand: in idle mode a frame is only drawn when something visible changed,
+// otherwise the loop blocks on events and the last frame stays on screen.
+const double IDLE_WAIT_SECONDS = 0.25;
+bool idleMode = false;
+bool paused = false;
+// set by anything that changes the picture outside of the camera and the simulation clock
+bool frameDirty = true;
+float simulationTime = 0.0f;
+
+struct CameraState {
+    glm::vec3 position;
+    glm::vec3 front;
+    float zoom;
+
+    static CameraState from(const Camera* camera) {
+        return { camera->Position, camera->Front, camera->Zoom };
+    }
+
+    bool operator==(const CameraState& other) const {
+        return position == other.position && front == other.front && zoom == other.zoom;
+    }
+};
+
+CameraState lastCameraState;
+
+// All particles are added into a floating point target, then one pass maps it to the screen.
+int framebufferWidth = VIEW_PORT_WIDTH;
+int framebufferHeight = VIEW_PORT_HEIGHT;
+RenderTarget* hdrTarget;
+Shader* tonemapShader;
+unsigned int screenVAO;
+float exposure = 1.0f;
+
+// Additive blending suits emissive particles. Weighted blended OIT lets dust absorb the light behind it.
+enum CompositeMode {
+    additiveComposite,
+    oitComposite,
+    sortedComposite,
+    compositeModeCount
+};
+
+const char* compositeModeNames[] = { "additive", "weighted blended OIT", "sorted back to front" };
+
+CompositeMode compositeMode = additiveComposite;
+RenderTarget* oitTarget;
+Shader* oitResolveShader;
+float dustOpacity = 0.02f;
+
+// Exact back to front blending for offline stills: every particle of every galaxy gets a
+// depth key, a radix sort orders them and one draw composites them with the over operator.
+// The CPU path reads the keys back and sorts them on all cores, as a reference for the GPU sort.
+const unsigned int RADIX_BLOCK_ITEMS = 256 * 16;
+Shader* depthKeyShader;
+Shader* radixHistogramShader;
+Shader* radixScanShader;
+Shader* radixScatterShader;
+Shader* sortedParticleShader;
+unsigned int sortKeys[2];
+unsigned int sortValues[2];
+unsigned int sortBlockOffsets;
+unsigned int sortCapacity = 0;
+GpuTimer* sortTimer;
+bool cpuSort = false;
+double cpuSortMilliseconds = 0.0;
+unsigned int sortReportFrame = 0;
+
+// Bloom: a chain of half size targets, filled by downsampling the HDR target and then
+// upsampled back with additive blending. The cost only depends on the resolution.
+const int BLOOM_LEVELS = 5;
+RenderTarget* bloomLevels[BLOOM_LEVELS];
+Shader* bloomDownsampleShader;
+Shader* bloomUpsampleShader;
+GpuTimer* bloomTimer;
+bool bloomEnabled = true;
+float bloomThreshold = 0.8f;
+float bloomIntensity = 0.35f;
+unsigned int bloomReportFrame = 0;
+
+// The dust sprites are large and soft, in additive mode they can be drawn into a target at
+// 1/2 or 1/4 of the screen resolution and upsampled onto the full resolution stars and H2.
+int dustDivisor = 1;
+RenderTarget* dustTarget;
+Shader* dustUpsampleShader;
+float dustEdgeSharpness = 8.0f;
+// height of the target the particles are drawn into, for the projected diameter
+int particleViewportHeight = VIEW_PORT_HEIGHT;
+
+// Volumetric dust: the dust of every template is splatted into a 3D grid in its local space
+// and ray marched inside each galaxy's bounding box, with a coarse occupancy grid to skip
+// empty space. New particles are splatted at once. When only the simulation time moves, the
+// refresh is spread over frames, at most VOLUME_SPLAT_BUDGET particles each, while the march
+// keeps using the last resolved volume, so the per frame cost no longer grows with the dust.
+const int VOLUME_SIZE_XZ = 128;
+const int VOLUME_SIZE_Y = 16;
+const int OCCUPANCY_CELL = 8;
+// the dust disk in local units, before the particle scale
+const glm::vec3 VOLUME_MIN = glm::vec3(-1000.0f, 40.0f, -1000.0f);
+const glm::vec3 VOLUME_MAX = glm::vec3(1000.0f, 160.0f, 1000.0f);
+const unsigned int VOLUME_SPLAT_BUDGET = 32768;
+const unsigned int VOLUME_SPLAT_GROUP_SIZE = 256;
+bool volumetricDust = false;
+bool volumeDirty = true;
+// simulation time of the refresh in progress or, once it is done, of the resolved volumes
+float volumeSplatTime = -1.0f;
+// the refresh in progress splats nextDustParticle onwards of refreshTemplate
+bool volumeRefreshing = false;
+int refreshTemplate = 0;
+unsigned int nextDustParticle = 0;
+unsigned int splatTextures[NUMBER_TEMPLATE][3];
+unsigned int volumeTextures[NUMBER_TEMPLATE];
+unsigned int occupancyTextures[NUMBER_TEMPLATE];
+Shader* volumeSplatShader;
+Shader* volumeClearShader;
+Shader* volumeClearOccupancyShader;
+Shader* volumeResolveShader;
+Shader* volumeMarchShader;
+
+// Impostors: a galaxy that covers few pixels is captured into its own layer of a texture
+// array from the current camera and drawn as one quad, with its draw commands set to zero
+// instances. A capture is redone when the view direction, distance or time has drifted too
+// far, at most IMPOSTOR_REFRESH_BUDGET captures per frame, the most outdated first.
+const int IMPOSTOR_SIZE = 128;
+const int IMPOSTOR_REFRESH_BUDGET = 8;
+// galaxies smaller than this on screen (bounding sphere diameter) use their impostor
+const float IMPOSTOR_MAX_PIXELS = 128.0f;
+const float IMPOSTOR_MAX_ANGLE = glm::radians(2.0f);
+const float IMPOSTOR_MAX_DISTANCE_RATIO = 0.1f;
+const float IMPOSTOR_MAX_TIME = 0.5f;
+// bounding sphere of a template around its origin, before the galaxy scale
+const float GALAXY_RADIUS = 23000.0f;
+
+struct ImpostorState {
+    bool valid;
+    bool active;
+    glm::vec3 direction;
+    float distance;
+    float time;
+    float halfSize;
+};
+
+bool impostorsEnabled = false;
+ImpostorState impostorStates[MAX_GALAXIES];
+unsigned int impostorTexture;
+unsigned int impostorFBO;
+unsigned int impostorQuadBuffer;
+unsigned int impostorCount = 0;
+Shader* impostorShader;
+
+// Temporal dust: every frame draws one of TEMPORAL_SUBSETS slices of the dust, at its plain
+// brightness, into its own target. The composite sums the last TEMPORAL_SUBSETS slices, so a
+// still view shows every particle exactly once. Each slice is reprojected through the galactic
+// plane, where the dust lies, from the camera it was drawn with, so it follows the camera.
+// Frames keep being drawn after the last change until every slice is fresh.
+const unsigned int TEMPORAL_SUBSETS = 4;
+const unsigned int TEMPORAL_SETTLE_FRAMES = TEMPORAL_SUBSETS;
+// the dust plane at local height 100, scaled like the particles
+const float DUST_PLANE_HEIGHT = 100.0f * 22.4f;
+bool temporalDust = false;
+// bit i is set while slice i holds a subset
+unsigned int validSlices = 0;
+unsigned int temporalFrame = 0;
+unsigned int temporalSettle = 0;
+RenderTarget* temporalSlices[TEMPORAL_SUBSETS];
+glm::mat4 sliceViewProjections[TEMPORAL_SUBSETS];
+Shader* temporalCompositeShader;
 GLFWwindow* window;
 
 
-Particle particles[NUMBER_PARTICLE];
+// Overdraw instrumentation: the OVERDRAW variant counts every particle fragment per pixel
+// and per type into an integer image array. The counts are shown as a heatmap, and every
+// OVERDRAW_REPORT_FRAMES frames they are reduced on the GPU and written to the log.
+const unsigned int OVERDRAW_REPORT_FRAMES = 60;
+const char* particleTypeNames[] = { "stars", "dust", "H2" };
+unsigned int overdrawTexture = 0;
+int overdrawWidth = 0;
+int overdrawHeight = 0;
+unsigned int overdrawSummaryBuffer;
+unsigned int overdrawFrame = 0;
+float maxOverdraw = 64.0f;
+Shader* overdrawClearShader;
+Shader* overdrawReduceShader;
+Shader* overdrawHeatmapShader;
+
+// Particle sprites, one layer per ParticleType. Files that are missing are replaced by
+// procedural sprites that reproduce the analytic falloffs the shader used before.
+const int SPRITE_SIZE = 64;
+const int SPRITE_TEXTURE_UNIT = 7;
+const vector<string> spritePaths = { "sprites/star_psf.png", "sprites/dust_puff.png", "sprites/h2_nebula.png" };
+SpriteArray* sprites;
+
+// Star colors by temperature, built by the compiler and sampled with linear filtering.
+// Temperatures outside the range get the color of its nearest end.
+const int BLACKBODY_TABLE_SIZE = 128;
+constexpr float BLACKBODY_MIN_TEMP = 1000.0f;
+constexpr float BLACKBODY_MAX_TEMP = 10000.0f;
+const int BLACKBODY_TEXTURE_UNIT = 8;
+constexpr blackbody::Table<BLACKBODY_TABLE_SIZE> blackbodyTable =
+    blackbody::makeTable<BLACKBODY_TABLE_SIZE>(BLACKBODY_MIN_TEMP, BLACKBODY_MAX_TEMP);
+
+// Table::colors() takes the SSE2 path for whole groups of four and color() for the rest,
+// both have to agree everywhere, clamped ends included. 203 temperatures from below the
+// range to above it leave a tail of three for the scalar loop.
+void checkBlackbodyTable() {
+    const int COUNT = 203;
+    float temps[COUNT], red[COUNT], green[COUNT], blue[COUNT];
+    for (int i = 0; i < COUNT; ++i)
+        temps[i] = glm::mix(BLACKBODY_MIN_TEMP - 500.0f, BLACKBODY_MAX_TEMP + 500.0f, (float)i / (COUNT - 1));
+    blackbodyTable.colors(temps, red, green, blue, COUNT);
+
+    for (int i = 0; i < COUNT; ++i) {
+        glm::vec3 expected = blackbodyTable.color(temps[i]);
+        if (glm::any(glm::greaterThan(glm::abs(glm::vec3(red[i], green[i], blue[i]) - expected), glm::vec3(1e-5f)))) {
+            cout << "ERROR::BLACKBODY::MISMATCH colors() at " << temps[i] << " K gives " << red[i] << " " << green[i] << " " << blue[i]
+                << ", color() " << expected.r << " " << expected.g << " " << expected.b << endl;
+            return;
+        }
+    }
+}
+
+void proceduralSprite(int layer, int size, unsigned char* rgba) {
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            glm::vec2 centered = 2.0f * (glm::vec2(x + 0.5f, y + 0.5f) / (float)size - 0.5f);
+            float falloff = glm::max(1.0f - glm::length(centered), 0.0f);
+            glm::vec4 color = glm::vec4(1.0f);
+            if (layer == dustParticle) {
+                color = glm::vec4(0.5f, 0.5f, 1.0f, falloff);
+            }
+            else if (layer == h2Particle) {
+                color = glm::vec4(glm::mix(glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(1.0f), falloff * falloff * falloff), falloff * falloff);
+            }
+
+            for (int c = 0; c < 4; ++c)
+                rgba[(y * size + x) * 4 + c] = (unsigned char)(color[c] * 255.0f + 0.5f);
+        }
+    }
+}
 
 enum RenderMode {
     wireframeMode,
     pointMode,
-    fillMode
+    fillMode,
+    overdrawMode
 };
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
@@ -133,36 +548,1173 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     windowUtil->mouse_callback(window, xpos, ypos, camera);
 }
 
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    WindowsUtil::framebuffer_size_callback(window, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
+    frameDirty = true;
+}
+
+// the window system lost the window contents (uncovered, restored), it has to be drawn again
+void window_refresh_callback(GLFWwindow* window)
+{
+    frameDirty = true;
+}
+
+
+// explicit locations in particleProcessor.comp, which may be loaded from SPIR-V
+const UniformHandle particleBaseUniform = Shader::handle("particleBase", 16);
+const UniformHandle seedOffsetUniform = Shader::handle("seedOffset", 17);
+
+// The static_asserts only hold the C++ structs to the packing rules, this asks the driver
+// where it actually put a member. Members the compiler stripped, and programs loaded from
+// SPIR-V without names, are not found and skipped.
+void checkLayout(Shader* shader, GLenum programInterface, const char* member, GLint offset, GLint arrayStride = 0) {
+    GLuint index = glGetProgramResourceIndex(shader->ID, programInterface, member);
+    if (index == GL_INVALID_INDEX)
+        return;
+
+    GLenum properties[] = { GL_OFFSET, GL_TOP_LEVEL_ARRAY_STRIDE };
+    GLint values[2] = { 0, 0 };
+    GLsizei queried = programInterface == GL_BUFFER_VARIABLE ? 2 : 1;
+    glGetProgramResourceiv(shader->ID, programInterface, index, queried, properties, queried, NULL, values);
+    if (values[0] != offset || (queried == 2 && values[1] != arrayStride))
+        cout << "ERROR::LAYOUT::MISMATCH " << member << " offset " << values[0] << " stride " << values[1]
+            << ", the host expects " << offset << " and " << arrayStride << endl;
+}
+
+void checkLayouts() {
+    if (packedParticles)
+        checkLayout(computeShader, GL_BUFFER_VARIABLE, "particles[0].words", 0, sizeof(PackedParticle));
+    else
+        checkLayout(computeShader, GL_BUFFER_VARIABLE, "particles[0].temp", offsetof(Particle, temp), sizeof(Particle));
+    checkLayout(computeShader, GL_UNIFORM, "minTemp", offsetof(ComputeParameters, minTemp));
+    checkLayout(depthKeyShader, GL_BUFFER_VARIABLE, "galaxies[0].particleBase", offsetof(GalaxyInstance, particleBase), sizeof(GalaxyInstance));
+    checkLayout(impostorShader, GL_BUFFER_VARIABLE, "impostors[0].layer", offsetof(ImpostorQuad, layer), sizeof(ImpostorQuad));
+}
+
+void generateParticles(ComputeParameters cParam, unsigned int computeParams) {
+    computeShader->use();
+    glBindBuffer(GL_UNIFORM_BUFFER, computeParams);
+    for (int t = 0; t < NUMBER_TEMPLATE; ++t) {
+        cParam.offset = templateShapes[t].offset;
+        cParam.inExc = templateShapes[t].inExc;
+        cParam.outExc = templateShapes[t].outExc;
+        cParam.inExcDiv = 1 - cParam.inExc;
+        cParam.outExcDiv = 1 - cParam.outExc;
+        cParam.speed = templateShapes[t].speed;
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ComputeParameters), &cParam);
+
+        computeShader->setUint(particleBaseUniform, t * NUMBER_PARTICLE);
+        computeShader->setInt(seedOffsetUniform, t * NUMBER_PARTICLE);
+        glDispatchCompute(NUMBER_PARTICLE / PARTICLE_WORKGROUP_SIZE, 1, 1);
+    }
+
+    // make sure writing to image has finished before read
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(0);
+}
+
+// a single galaxy at the origin, or a cluster of galaxies reusing the templates
+void buildScene(bool cluster) {
+    galaxies.clear();
+    if (!cluster) {
+        galaxies.push_back({ glm::mat4(1.0f), glm::vec4(1.0f), 1.0f, 0.0f, 0, 0.0f });
+    }
+    else {
+        srand_set(1234);
+        for (int i = 0; i < MAX_GALAXIES; ++i) {
+            glm::vec3 position = glm::vec3(myRand() - 0.5f, (myRand() - 0.5f) * 0.3f, myRand() - 0.5f) * 2.0f * CLUSTER_RADIUS;
+            glm::vec3 axis = glm::normalize(glm::vec3(myRand() - 0.5f, myRand() - 0.5f, myRand() - 0.5f) + glm::vec3(0.0f, 0.001f, 0.0f));
+
+            GalaxyInstance galaxy;
+            galaxy.model = glm::rotate(glm::translate(glm::mat4(1.0f), position), (float)myRand() * 2.0f * PI, axis);
+            galaxy.tint = glm::vec4(glm::mix(glm::vec3(1.0f), glm::vec3(myRand(), myRand(), myRand()), 0.3f), 1.0f);
+            galaxy.scale = 0.05f + 0.2f * (float)myRand();
+            galaxy.timeOffset = 1000.0f * (float)myRand();
+            galaxy.particleBase = (i % NUMBER_TEMPLATE) * NUMBER_PARTICLE;
+            galaxy.padding = 0.0f;
+            galaxies.push_back(galaxy);
+        }
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, galaxySsbo);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, galaxies.size() * sizeof(GalaxyInstance), galaxies.data());
+}
+
+GLintptr arraysCommandOffset(int type) {
+    return type * MAX_GALAXIES * sizeof(DrawArraysIndirectCommand);
+}
+
+GLintptr sphereDrawOffset(int type) {
+    return type * SPHERE_DRAWS_PER_PASS * sizeof(DrawElementsIndirectCommand);
+}
+
+void applyParticleBudget(float budget) {
+    for (ParticlePass& pass : particlePasses) {
+        pass.drawCount = glm::max(1u, (unsigned int)(pass.particleCount * budget));
+        pass.drawFirst = 0;
+        pass.drawInstances = pass.drawCount;
+    }
+
+    // a different slice of the dust prefix every frame, the composite adds up the last ones
+    if (temporalDust && compositeMode == additiveComposite) {
+        ParticlePass& dust = particlePasses[dustParticle];
+        // rounded up so the subsets cover every particle, the last one takes what is left
+        unsigned int slice = (dust.drawCount + TEMPORAL_SUBSETS - 1) / TEMPORAL_SUBSETS;
+        dust.drawFirst = glm::min((temporalFrame % TEMPORAL_SUBSETS) * slice, dust.drawCount - 1);
+        dust.drawInstances = glm::min(slice, dust.drawCount - dust.drawFirst);
+    }
+}
+
+void setDrawnGalaxies(const vector<GLuint>& drawn) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawnGalaxyBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, drawn.size() * sizeof(GLuint), drawn.data());
+    drawnGalaxyCount = (GLuint)drawn.size();
+}
+
+void buildDrawCommands() {
+    vector<DrawArraysIndirectCommand> arrayCommands(galaxies.size());
+    vector<GLuint> drawn;
+    for (GLuint g = 0; g < galaxies.size(); ++g) {
+        if (!impostorStates[g].active)
+            drawn.push_back(g);
+    }
+    setDrawnGalaxies(drawn);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+    for (int type = 0; type < particleTypeCount; ++type) {
+        const ParticlePass& pass = particlePasses[type];
+        for (GLuint g = 0; g < galaxies.size(); ++g)
+            arrayCommands[g] = { pass.drawInstances, impostorStates[g].active ? 0u : 1u, 0, g };
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, arraysCommandOffset(type), arrayCommands.size() * sizeof(DrawArraysIndirectCommand), arrayCommands.data());
+    }
+
+    emptySphereDraws.resize(particleTypeCount * SPHERE_DRAWS_PER_PASS);
+    for (int type = 0; type < particleTypeCount; ++type) {
+        DrawElementsIndirectCommand* draws = &emptySphereDraws[type * SPHERE_DRAWS_PER_PASS];
+        draws[0] = { particlePasses[type].indexCount, 0, 0, 0, 0 };
+        for (GLuint g = 0; g < MAX_GALAXIES; ++g)
+            draws[1 + g] = { particlePasses[type].indexCount, 0, 0, 0, g };
+    }
+}
+
+void bindGalaxyIdAttribute(unsigned int vao) {
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, galaxyIdBuffer);
+    glEnableVertexAttribArray(4);
+    glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, 0, (void*)0);
+    glVertexAttribDivisor(4, GALAXY_ID_DIVISOR);
+    glBindVertexArray(0);
+}
+
+void initGalaxyBuffers() {
+    vector<GLuint> galaxyIds(MAX_GALAXIES);
+    for (GLuint i = 0; i < MAX_GALAXIES; ++i)
+        galaxyIds[i] = i;
+
+    glGenBuffers(1, &galaxyIdBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, galaxyIdBuffer);
+    glBufferData(GL_ARRAY_BUFFER, galaxyIds.size() * sizeof(GLuint), galaxyIds.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &galaxySsbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, galaxySsbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_GALAXIES * sizeof(GalaxyInstance), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, galaxySsbo);
+
+    glGenBuffers(1, &drawCommandBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, arraysCommandOffset(particleTypeCount), NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &drawnGalaxyBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawnGalaxyBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_GALAXIES * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, drawnGalaxyBuffer);
+
+    glGenBuffers(1, &sphereListBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphereListBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, NUMBER_TEMPLATE * NUMBER_PARTICLE * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, sphereListBuffer);
+
+    glGenBuffers(1, &sphereDrawBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphereDrawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sphereDrawOffset(particleTypeCount), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, sphereDrawBuffer);
+
+    glGenBuffers(1, &sphereReservationBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphereReservationBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, particleTypeCount * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, sphereReservationBuffer);
+}
+
+// true only on the frame the key goes down
+bool keyPressed(int key) {
+    static bool wasDown[GLFW_KEY_LAST + 1] = {};
+    bool down = glfwGetKey(window, key) == GLFW_PRESS;
+    bool pressed = down && !wasDown[key];
+    wasDown[key] = down;
+    return pressed;
+}
+
+// uniforms set for every particle draw, registered before any program is linked. The
+// locations are the explicit ones of GalaxyShader.vs and .frag, which may be loaded from SPIR-V.
+const UniformHandle projectionUniform = Shader::handle("projection", 0);
+const UniformHandle viewUniform = Shader::handle("view", 1);
+const UniformHandle camPosUniform = Shader::handle("camPos");
+const UniformHandle modelUniform = Shader::handle("model", 2);
+const UniformHandle timeUniform = Shader::handle("time", 4);
+const UniformHandle viewportHeightUniform = Shader::handle("viewportHeight", 6);
+const UniformHandle dustOpacityUniform = Shader::handle("dustOpacity", 12);
+// bound to SPRITE_TEXTURE_UNIT by the layout too, this only matters for source builds
+const UniformHandle spriteTextureUniform = Shader::handle("spriteTexture");
+const UniformHandle blackbodyColorsUniform = Shader::handle("blackbodyColors");
+const UniformHandle firstParticleUniform = Shader::handle("firstParticle", 5);
+const UniformHandle pointThresholdUniform = Shader::handle("pointThreshold", 7);
+const UniformHandle brightnessScaleUniform = Shader::handle("brightnessScale", 8);
+const UniformHandle listedSpheresUniform = Shader::handle("listedSpheres", 9);
+const UniformHandle listBaseUniform = Shader::handle("listBase", 10);
+const UniformHandle drawBaseUniform = Shader::handle("drawBase", 11);
+const UniformHandle spriteAverageUniform = Shader::handle("spriteAverage", 13);
+// the classifier's, per pass
+const UniformHandle particleTypeUniform = Shader::handle("particleType");
+const UniformHandle particleCountUniform = Shader::handle("particleCount");
+const UniformHandle listCapacityUniform = Shader::handle("listCapacity");
+
+void setFrameUniforms(Shader* shader, const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time) {
+    shader->use();
+    shader->setMat4(projectionUniform, projection);
+    shader->setMat4(viewUniform, view);
+    shader->setVec3(camPosUniform, camera->Position);
+    shader->setMat4(modelUniform, model);
+    shader->setFloat(timeUniform, time);
+    shader->setFloat(viewportHeightUniform, (float)particleViewportHeight);
+    shader->setFloat(dustOpacityUniform, dustOpacity);
+    shader->setInt(spriteTextureUniform, SPRITE_TEXTURE_UNIT);
+    shader->setInt(blackbodyColorsUniform, BLACKBODY_TEXTURE_UNIT);
+}
+
+void setParticleUniforms(Shader* shader, int type, const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time) {
+    const ParticlePass& pass = particlePasses[type];
+    setFrameUniforms(shader, projection, view, model, time);
+    shader->setUint(firstParticleUniform, pass.firstParticle + pass.drawFirst);
+    shader->setFloat(pointThresholdUniform, pointSplatting ? pointThreshold : 0.0f);
+    // a temporal slice keeps the plain brightness, the composite adds up the slices
+    shader->setFloat(brightnessScaleUniform, (float)pass.particleCount / (float)pass.drawCount);
+    shader->setVec4(spriteAverageUniform, sprites->diskAverage(type));
+}
+
+// fills the sphere list and the instance counts of sphereDrawBuffer for the passes in typeMask
+void classifyParticles(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time, unsigned int typeMask) {
+    GLuint reserved[particleTypeCount] = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphereDrawBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, emptySphereDraws.size() * sizeof(DrawElementsIndirectCommand), emptySphereDraws.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphereReservationBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(reserved), reserved);
+
+    classifyShader->use();
+    classifyShader->setMat4(projectionUniform, projection);
+    classifyShader->setMat4(viewUniform, view);
+    classifyShader->setMat4(modelUniform, model);
+    classifyShader->setFloat(timeUniform, time);
+    classifyShader->setFloat(viewportHeightUniform, (float)particleViewportHeight);
+    // without the point path every particle is a sphere
+    classifyShader->setFloat(pointThresholdUniform, pointSplatting ? pointThreshold : 0.0f);
+    for (int type = 0; type < particleTypeCount; ++type) {
+        if (!(typeMask & (1u << type)))
+            continue;
+        const ParticlePass& pass = particlePasses[type];
+        classifyShader->setUint(particleTypeUniform, type);
+        classifyShader->setUint(firstParticleUniform, pass.firstParticle + pass.drawFirst);
+        classifyShader->setUint(particleCountUniform, pass.drawInstances);
+        classifyShader->setUint(listBaseUniform, NUMBER_TEMPLATE * pass.firstParticle);
+        classifyShader->setUint(listCapacityUniform, NUMBER_TEMPLATE * pass.particleCount);
+        classifyShader->setUint(drawBaseUniform, type * SPHERE_DRAWS_PER_PASS);
+        glDispatchCompute((pass.drawInstances + CLASSIFY_GROUP_SIZE - 1) / CLASSIFY_GROUP_SIZE, drawnGalaxyCount, 1);
+    }
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+const unsigned int ALL_PARTICLE_TYPES = (1u << particleTypeCount) - 1;
+
+// the sphere sized particles of the drawn galaxies, listed by the classifier
+void drawSpheres(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time, unsigned int variant, unsigned int typeMask) {
+    GLsizei galaxyCount = (GLsizei)galaxies.size();
+    classifyParticles(projection, view, model, time, typeMask);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sphereDrawBuffer);
+    // the spheres are closed, drawing their back faces too would count every particle twice
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    for (int type = 0; type < particleTypeCount; ++type) {
+        if (!(typeMask & (1u << type)))
+            continue;
+        ParticlePass& pass = particlePasses[type];
+        Shader* shader = pass.programs->get(variant);
+        setParticleUniforms(shader, type, projection, view, model, time);
+        shader->setUint(listBaseUniform, NUMBER_TEMPLATE * pass.firstParticle);
+        shader->setUint(drawBaseUniform, type * SPHERE_DRAWS_PER_PASS);
+        glBindVertexArray(pass.vao);
+        shader->setBool(listedSpheresUniform, true);
+        glDrawElementsIndirect(pass.primitive, GL_UNSIGNED_INT, (void*)sphereDrawOffset(type));
+        // empty unless a galaxy overflowed the list
+        shader->setBool(listedSpheresUniform, false);
+        glMultiDrawElementsIndirect(pass.primitive, GL_UNSIGNED_INT, (void*)(sphereDrawOffset(type) + sizeof(DrawElementsIndirectCommand)), galaxyCount, 0);
+    }
+    glDisable(GL_CULL_FACE);
+}
+
+// typeMask selects the passes to draw, one bit per ParticleType
+void drawParticles(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time, unsigned int variant, unsigned int typeMask = ALL_PARTICLE_TYPES) {
+    GLsizei galaxyCount = (GLsizei)galaxies.size();
+    drawSpheres(projection, view, model, time, variant, typeMask);
+
+    if (!pointSplatting)
+        return;
+
+    // sub-pixel particles, one vertex each
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+    glBindVertexArray(pointVAO);
+    for (int type = 0; type < particleTypeCount; ++type) {
+        if (!(typeMask & (1u << type)))
+            continue;
+        ParticlePass& pass = particlePasses[type];
+        setParticleUniforms(pass.programs->get(variant | pointVariant), type, projection, view, model, time);
+        glMultiDrawArraysIndirect(GL_POINTS, (void*)arraysCommandOffset(type), galaxyCount, 0);
+    }
+}
+
+void ensureSortCapacity(unsigned int count) {
+    if (count <= sortCapacity)
+        return;
+
+    if (sortCapacity != 0) {
+        glDeleteBuffers(2, sortKeys);
+        glDeleteBuffers(2, sortValues);
+        glDeleteBuffers(1, &sortBlockOffsets);
+    }
+    sortCapacity = count;
+    unsigned int numBlocks = (count + RADIX_BLOCK_ITEMS - 1) / RADIX_BLOCK_ITEMS;
+
+    glGenBuffers(2, sortKeys);
+    glGenBuffers(2, sortValues);
+    glGenBuffers(1, &sortBlockOffsets);
+    for (int i = 0; i < 2; ++i) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sortKeys[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sortValues[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sortBlockOffsets);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 256 * numBlocks * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    cout << "Depth sort buffers resized for " << count << " keys" << endl;
+}
+
+// four 8 bit passes, ping-ponging so the result ends up back in sortKeys[0] / sortValues[0]
+void gpuRadixSort(unsigned int count) {
+    unsigned int numBlocks = (count + RADIX_BLOCK_ITEMS - 1) / RADIX_BLOCK_ITEMS;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, sortBlockOffsets);
+
+    for (unsigned int pass = 0; pass < 4; ++pass) {
+        int source = pass % 2;
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, sortKeys[source]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, sortValues[source]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, sortKeys[1 - source]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, sortValues[1 - source]);
+
+        for (Shader* stage : { radixHistogramShader, radixScanShader, radixScatterShader }) {
+            stage->use();
+            stage->setUint("keyCount", count);
+            stage->setUint("numBlocks", numBlocks);
+            stage->setUint("shift", pass * 8);
+            glDispatchCompute(stage == radixScanShader ? 1 : numBlocks, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+    }
+}
+
+void cpuRadixSort(unsigned int count) {
+    vector<uint32_t> keys(count);
+    vector<uint32_t> values(count);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sortKeys[0]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(uint32_t), keys.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sortValues[0]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(uint32_t), values.data());
+
+    auto start = chrono::high_resolution_clock::now();
+    radixSortParallel(keys, values);
+    cpuSortMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(uint32_t), values.data());
+}
+
+// returns the number of sorted particles, their indices are in sortValues[0]
+unsigned int sortParticlesByDepth(const glm::mat4& view, const glm::mat4& model, float time) {
+    unsigned int count = (unsigned int)galaxies.size() * NUMBER_PARTICLE;
+    ensureSortCapacity(count);
+
+    sortTimer->begin();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, sortKeys[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, sortValues[0]);
+    depthKeyShader->use();
+    depthKeyShader->setMat4("view", view);
+    depthKeyShader->setMat4("model", model);
+    depthKeyShader->setFloat("time", time);
+    depthKeyShader->setUint("keyCount", count);
+    glDispatchCompute(glm::min((count + 255) / 256, 65535u), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    if (cpuSort)
+        cpuRadixSort(count);
+    else
+        gpuRadixSort(count);
+    sortTimer->end();
+
+    if (++sortReportFrame % 60 == 0) {
+        cout << "Depth sort: " << count << " keys, GPU " << sortTimer->milliseconds << " ms";
+        if (cpuSort)
+            cout << " (CPU sort " << cpuSortMilliseconds << " ms)";
+        cout << endl;
+    }
+    return count;
+}
+
+void applyRenderMode(RenderMode renderMode) {
+    switch (renderMode) {
+    case fillMode:
+    case overdrawMode:
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); // el modo wireframe
+        break;
+    case pointMode:
+        glPolygonMode(GL_FRONT_AND_BACK, GL_POINT); // el modo wireframe
+        break;
+    case wireframeMode:
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); // el modo wireframe
+        break;
+    default:
+        break;
+    }
+}
+
+void drawScreenQuad();
+
+// One geometry pass into the accumulation and revealage targets, then a resolve pass
+// blends the weighted average color over the HDR target. No sorting needed.
+void renderOit(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time, RenderMode renderMode) {
+    static const float clearAccum[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    static const float clearRevealage[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    oitTarget->bind();
+    glClearBufferfv(GL_COLOR, 0, clearAccum);
+    glClearBufferfv(GL_COLOR, 1, clearRevealage);
+
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+    applyRenderMode(renderMode);
+    drawParticles(projection, view, model, time, oitVariant);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    hdrTarget->bind();
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    oitResolveShader->use();
+    oitResolveShader->setInt("accumTexture", 0);
+    oitResolveShader->setInt("revealageTexture", 1);
+    oitTarget->bindTexture(0, 0);
+    oitTarget->bindTexture(1, 1);
+    drawScreenQuad();
+    glDisable(GL_BLEND);
+}
+
+// additive dust at reduced resolution, composited onto the HDR target with an edge aware upsample
+void renderLowResDust(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time) {
+    dustTarget->resize(glm::max(framebufferWidth / dustDivisor, 1), glm::max(framebufferHeight / dustDivisor, 1));
+    dustTarget->bind();
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    particleViewportHeight = dustTarget->height;
+    drawParticles(projection, view, model, time, 0, 1u << dustParticle);
+    particleViewportHeight = framebufferHeight;
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    hdrTarget->bind();
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
+    dustUpsampleShader->use();
+    dustUpsampleShader->setInt("dustBuffer", 0);
+    dustUpsampleShader->setVec2("dustTexelSize", glm::vec2(1.0f / dustTarget->width, 1.0f / dustTarget->height));
+    dustUpsampleShader->setFloat("edgeSharpness", dustEdgeSharpness);
+    dustTarget->bindTexture(0);
+    drawScreenQuad();
+}
+
+unsigned int createVolumeTexture(GLenum internalFormat, int width, int height, int depth, GLenum filter) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glTexStorage3D(GL_TEXTURE_3D, 1, internalFormat, width, height, depth);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+void initDustVolumes() {
+    for (int t = 0; t < NUMBER_TEMPLATE; ++t) {
+        for (unsigned int& channel : splatTextures[t]) {
+            channel = createVolumeTexture(GL_R32UI, VOLUME_SIZE_XZ, VOLUME_SIZE_Y, VOLUME_SIZE_XZ, GL_NEAREST);
+        }
+        volumeTextures[t] = createVolumeTexture(GL_RGBA16F, VOLUME_SIZE_XZ, VOLUME_SIZE_Y, VOLUME_SIZE_XZ, GL_LINEAR);
+        occupancyTextures[t] = createVolumeTexture(GL_R8, VOLUME_SIZE_XZ / OCCUPANCY_CELL, VOLUME_SIZE_Y / OCCUPANCY_CELL, VOLUME_SIZE_XZ / OCCUPANCY_CELL, GL_NEAREST);
+    }
+}
+
+void dispatchVolume(Shader* shader) {
+    shader->use();
+    glDispatchCompute(VOLUME_SIZE_XZ / 8, VOLUME_SIZE_Y / 4, VOLUME_SIZE_XZ / 8);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void bindVolumeImages(int t) {
+    for (int channel = 0; channel < 3; ++channel) {
+        glBindImageTexture(channel, splatTextures[t][channel], 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+    }
+    glBindImageTexture(3, volumeTextures[t], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glBindImageTexture(4, occupancyTextures[t], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R8);
+}
+
+// Splats up to budget particles of the refresh in progress, resolving each template whose
+// dust is all in. A template's volume and occupancy are only rewritten by its resolve.
+void continueVolumeRefresh(unsigned int budget) {
+    while (volumeRefreshing && budget > 0) {
+        bindVolumeImages(refreshTemplate);
+        if (nextDustParticle == 0)
+            dispatchVolume(volumeClearShader);
+
+        unsigned int count = glm::min(budget, (unsigned int)NUMBER_DUST - nextDustParticle);
+        volumeSplatShader->use();
+        volumeSplatShader->setFloat("time", volumeSplatTime);
+        volumeSplatShader->setUint("splatParticleBase", refreshTemplate * NUMBER_PARTICLE + NUMBER_STAR + nextDustParticle);
+        volumeSplatShader->setUint("splatCount", count);
+        volumeSplatShader->setVec3("volumeMin", VOLUME_MIN);
+        volumeSplatShader->setVec3("volumeMax", VOLUME_MAX);
+        glDispatchCompute((count + VOLUME_SPLAT_GROUP_SIZE - 1) / VOLUME_SPLAT_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        nextDustParticle += count;
+        budget -= count;
+
+        if (nextDustParticle == (unsigned int)NUMBER_DUST) {
+            dispatchVolume(volumeClearOccupancyShader);
+            dispatchVolume(volumeResolveShader);
+            nextDustParticle = 0;
+            if (++refreshTemplate == NUMBER_TEMPLATE)
+                volumeRefreshing = false;
+        }
+    }
+}
+
+void startVolumeRefresh(float time) {
+    volumeRefreshing = true;
+    refreshTemplate = 0;
+    nextDustParticle = 0;
+    volumeSplatTime = time;
+}
+
+void updateDustVolumes(float time) {
+    if (volumeDirty) {
+        // the old volumes show particles that no longer exist, rebuild them all now
+        startVolumeRefresh(time);
+        continueVolumeRefresh(NUMBER_TEMPLATE * NUMBER_DUST);
+        volumeDirty = false;
+        return;
+    }
+    if (!volumeRefreshing && time != volumeSplatTime)
+        startVolumeRefresh(time);
+    continueVolumeRefresh(VOLUME_SPLAT_BUDGET);
+}
+
+// additive, in place of the dust billboards
+void renderDustVolumes(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time) {
+    updateDustVolumes(time);
+
+    glm::vec3 cellSize = (VOLUME_MAX - VOLUME_MIN) / glm::vec3(VOLUME_SIZE_XZ, VOLUME_SIZE_Y, VOLUME_SIZE_XZ);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
+    // back faces only, so the march also starts when the camera is inside a box
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+
+    setFrameUniforms(volumeMarchShader, projection, view, model, time);
+    volumeMarchShader->setVec3("volumeMin", VOLUME_MIN);
+    volumeMarchShader->setVec3("volumeMax", VOLUME_MAX);
+    // a splatted particle adds brightness times the disk-averaged falloff over its sprite area
+    volumeMarchShader->setFloat("emissionScale", (PI / 3.0f) / (cellSize.x * cellSize.y * cellSize.z));
+    volumeMarchShader->setInt("dustVolume", 0);
+    volumeMarchShader->setInt("occupancy", 1);
+    glBindVertexArray(screenVAO);
+    for (int t = 0; t < NUMBER_TEMPLATE; ++t) {
+        volumeMarchShader->setUint("templateIndex", t);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, volumeTextures[t]);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, occupancyTextures[t]);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)galaxies.size());
+    }
+
+    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
+}
+
+void initImpostors() {
+    glGenTextures(1, &impostorTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, impostorTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, (GLsizei)std::log2(IMPOSTOR_SIZE) + 1, GL_RGBA16F, IMPOSTOR_SIZE, IMPOSTOR_SIZE, MAX_GALAXIES);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(1, &impostorFBO);
+
+    glGenBuffers(1, &impostorQuadBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, impostorQuadBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_GALAXIES * sizeof(ImpostorQuad), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, impostorQuadBuffer);
+}
+
+void resetImpostors() {
+    for (ImpostorState& state : impostorStates) {
+        state.valid = false;
+        state.active = false;
+    }
+    impostorCount = 0;
+}
+
+// additive capture of a single galaxy, through a square frustum that just holds its bounding sphere
+void captureImpostor(GLuint g, const glm::vec3& center, float radius, const glm::mat4& model, float time) {
+    ImpostorState& state = impostorStates[g];
+    glm::vec3 toGalaxy = center - camera->Position;
+    state.distance = glm::length(toGalaxy);
+    state.direction = toGalaxy / state.distance;
+    state.time = time;
+    float halfAngle = std::asin(glm::min(radius / state.distance, 0.99f));
+    state.halfSize = state.distance * std::tan(halfAngle);
+    state.valid = true;
+
+    glm::mat4 projection = glm::perspective(2.0f * halfAngle, 1.0f, 0.1f, 100000.0f);
+    glm::mat4 view = glm::lookAt(camera->Position, center, camera->Up);
+
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, impostorTexture, 0, g);
+    glClear(GL_COLOR_BUFFER_BIT);
+    // a capture is kept for many frames, so it takes the whole prefix and not a temporal slice
+    ParticlePass& dust = particlePasses[dustParticle];
+    unsigned int dustFirst = dust.drawFirst;
+    unsigned int dustInstances = dust.drawInstances;
+    dust.drawFirst = 0;
+    dust.drawInstances = dust.drawCount;
+
+    setDrawnGalaxies({ g });
+    drawSpheres(projection, view, model, time, 0, ALL_PARTICLE_TYPES);
+    // the draw commands are built after the captures, so the points are drawn directly
+    if (pointSplatting) {
+        glBindVertexArray(pointVAO);
+        for (int type = 0; type < particleTypeCount; ++type) {
+            ParticlePass& pass = particlePasses[type];
+            setParticleUniforms(pass.programs->get(pointVariant), type, projection, view, model, time);
+            glDrawArraysInstancedBaseInstance(GL_POINTS, 0, pass.drawInstances, 1, g);
+        }
+    }
+
+    dust.drawFirst = dustFirst;
+    dust.drawInstances = dustInstances;
+}
+
+// picks the impostored galaxies for this frame and refreshes the most outdated captures,
+// must run before the draw commands and the drawn galaxy list are built
+void updateImpostors(const glm::mat4& projection, const glm::mat4& model, float time) {
+    bool usable = impostorsEnabled && compositeMode == additiveComposite && !volumetricDust;
+    vector<pair<float, GLuint>> refreshes;
+
+    for (GLuint g = 0; g < galaxies.size(); ++g) {
+        ImpostorState& state = impostorStates[g];
+        state.active = false;
+        if (!usable)
+            continue;
+
+        glm::vec3 center = glm::vec3(galaxies[g].model[3]);
+        float radius = GALAXY_RADIUS * galaxies[g].scale;
+        glm::vec3 toGalaxy = center - camera->Position;
+        float distance = glm::length(toGalaxy);
+        float pixels = 2.0f * radius * projection[1][1] * 0.5f * framebufferHeight / distance;
+        if (distance < 2.0f * radius || pixels > IMPOSTOR_MAX_PIXELS)
+            continue;
+
+        float staleness = 1000.0f;
+        if (state.valid) {
+            float angle = std::acos(glm::clamp(glm::dot(toGalaxy / distance, state.direction), -1.0f, 1.0f));
+            float distanceRatio = std::abs(distance / state.distance - 1.0f);
+            staleness = glm::max(angle / IMPOSTOR_MAX_ANGLE, glm::max(distanceRatio / IMPOSTOR_MAX_DISTANCE_RATIO, std::abs(time - state.time) / IMPOSTOR_MAX_TIME));
+            state.active = true;
+        }
+        if (staleness > 1.0f)
+            refreshes.push_back(make_pair(staleness, g));
+    }
+
+    if (!refreshes.empty()) {
+        sort(refreshes.begin(), refreshes.end(), [](const pair<float, GLuint>& a, const pair<float, GLuint>& b) { return a.first > b.first; });
+        refreshes.resize(glm::min((int)refreshes.size(), IMPOSTOR_REFRESH_BUDGET));
+
+        glBindFramebuffer(GL_FRAMEBUFFER, impostorFBO);
+        glViewport(0, 0, IMPOSTOR_SIZE, IMPOSTOR_SIZE);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ONE, GL_ONE);
+        particleViewportHeight = IMPOSTOR_SIZE;
+        for (const pair<float, GLuint>& refresh : refreshes) {
+            GLuint g = refresh.second;
+            captureImpostor(g, glm::vec3(galaxies[g].model[3]), GALAXY_RADIUS * galaxies[g].scale, model, time);
+            impostorStates[g].active = true;
+        }
+        glDisable(GL_BLEND);
+        particleViewportHeight = framebufferHeight;
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, impostorTexture);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+
+    vector<ImpostorQuad> quads;
+    for (GLuint g = 0; g < galaxies.size(); ++g) {
+        if (!impostorStates[g].active)
+            continue;
+        quads.push_back({ glm::vec4(glm::vec3(galaxies[g].model[3]), impostorStates[g].halfSize), glm::uvec4(g, 0, 0, 0) });
+    }
+    impostorCount = (unsigned int)quads.size();
+    if (impostorCount > 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, impostorQuadBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, quads.size() * sizeof(ImpostorQuad), quads.data());
+    }
+}
+
+void drawImpostors(const glm::mat4& projection, const glm::mat4& view) {
+    if (impostorCount == 0)
+        return;
+
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
+    impostorShader->use();
+    impostorShader->setMat4("projection", projection);
+    impostorShader->setMat4("view", view);
+    impostorShader->setInt("impostorTexture", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, impostorTexture);
+    glBindVertexArray(screenVAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, impostorCount);
+}
+
+// additive, draws this frame's dust subset into its slice and adds up the last slices
+void renderTemporalDust(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time) {
+    for (RenderTarget* slice : temporalSlices) {
+        if (slice->resize(framebufferWidth, framebufferHeight))
+            validSlices = 0;
+    }
+
+    unsigned int current = temporalFrame % TEMPORAL_SUBSETS;
+    glm::mat4 viewProjection = projection * view;
+    temporalSlices[current]->bind();
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    drawParticles(projection, view, model, time, 0, 1u << dustParticle);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    sliceViewProjections[current] = viewProjection;
+    validSlices |= 1u << current;
+
+    hdrTarget->bind();
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
+    temporalCompositeShader->use();
+    for (unsigned int i = 0; i < TEMPORAL_SUBSETS; ++i) {
+        temporalCompositeShader->setInt("sliceTextures[" + to_string(i) + "]", i);
+        temporalCompositeShader->setMat4("sliceViewProjections[" + to_string(i) + "]", sliceViewProjections[i]);
+        temporalSlices[i]->bindTexture(i);
+    }
+    temporalCompositeShader->setUint("validSlices", validSlices);
+    temporalCompositeShader->setMat4("inverseViewProjection", glm::inverse(viewProjection));
+    temporalCompositeShader->setVec3("camPos", camera->Position);
+    temporalCompositeShader->setFloat("planeHeight", DUST_PLANE_HEIGHT);
+    drawScreenQuad();
+
+    ++temporalFrame;
+}
+
+void initOverdraw() {
+    glGenBuffers(1, &overdrawSummaryBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, overdrawSummaryBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * (particleTypeCount + 1) * sizeof(GLuint), NULL, GL_DYNAMIC_READ);
+}
+
+void resizeOverdraw() {
+    if (overdrawTexture != 0 && overdrawWidth == framebufferWidth && overdrawHeight == framebufferHeight)
+        return;
+
+    if (overdrawTexture != 0)
+        glDeleteTextures(1, &overdrawTexture);
+    overdrawWidth = framebufferWidth;
+    overdrawHeight = framebufferHeight;
+    glGenTextures(1, &overdrawTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, overdrawTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32UI, overdrawWidth, overdrawHeight, particleTypeCount);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+void dispatchOverdraw(Shader* shader) {
+    shader->use();
+    glDispatchCompute((overdrawWidth + 15) / 16, (overdrawHeight + 15) / 16, 1);
+}
+
+// reads the whole reduction back, so it stalls, but only in this debug mode and once in a while
+void reportOverdraw() {
+    GLuint zeros[2 * (particleTypeCount + 1)] = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, overdrawSummaryBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, overdrawSummaryBuffer);
+    dispatchOverdraw(overdrawReduceShader);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    GLuint summary[2 * (particleTypeCount + 1)];
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(summary), summary);
+    const GLuint* fragments = summary;
+    const GLuint* coveredPixels = summary + particleTypeCount + 1;
+
+    double screenPixels = (double)overdrawWidth * overdrawHeight;
+    cout << "Overdraw: " << fragments[particleTypeCount] << " fragments, " << fragments[particleTypeCount] / screenPixels << " per screen pixel, "
+         << fragments[particleTypeCount] / glm::max(1.0, (double)coveredPixels[particleTypeCount]) << " per covered pixel" << endl;
+    for (int type = 0; type < particleTypeCount; ++type) {
+        cout << "    " << particleTypeNames[type] << ": " << fragments[type] << " fragments, "
+             << fragments[type] / glm::max(1.0, (double)coveredPixels[type]) << " per covered pixel, "
+             << 100.0 * fragments[type] / glm::max(1.0, (double)fragments[particleTypeCount]) << "% of all" << endl;
+    }
+}
+
+// counts the fragments of every particle pass, the heatmap itself is drawn by showOverdraw()
+void renderOverdraw(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time) {
+    resizeOverdraw();
+    glBindImageTexture(5, overdrawTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+    dispatchOverdraw(overdrawClearShader);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    hdrTarget->bind();
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    drawParticles(projection, view, model, time, overdrawVariant);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    if (++overdrawFrame % OVERDRAW_REPORT_FRAMES == 0) {
+        reportOverdraw();
+    }
+}
+
+void showOverdraw() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+    overdrawHeatmapShader->use();
+    overdrawHeatmapShader->setInt("overdrawCounts", 0);
+    overdrawHeatmapShader->setFloat("maxOverdraw", maxOverdraw);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, overdrawTexture);
+    drawScreenQuad();
+}
+
+void renderGalaxy(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float time, RenderMode renderMode) {
+    particleViewportHeight = framebufferHeight;
+    hdrTarget->bind();
+    glClearColor(0.001f, 0.001f, 0.001f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+
+    if (renderMode == overdrawMode) {
+        renderOverdraw(projection, view, model, time);
+        return;
+    }
+
+    if (compositeMode == oitComposite) {
+        renderOit(projection, view, model, time, renderMode);
+        return;
+    }
+
+    if (compositeMode == sortedComposite) {
+        unsigned int count = sortParticlesByDepth(view, model, time);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, sortValues[0]);
+
+        // premultiplied over operator, the farthest particle comes first
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        applyRenderMode(renderMode);
+        setFrameUniforms(sortedParticleShader, projection, view, model, time);
+        sortedParticleShader->setFloat("pointThreshold", 0.0f);
+        sortedParticleShader->setFloat("brightnessScale", 1.0f);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        glBindVertexArray(sphereVAO);
+        glDrawElementsInstanced(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0, count);
+        glDisable(GL_CULL_FACE);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glDisable(GL_BLEND);
+        return;
+    }
+
+    // additive accumulation needs neither depth nor sorting, alpha sums up the coverage
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ONE, GL_ONE);
+    applyRenderMode(renderMode);
+    if (volumetricDust) {
+        drawParticles(projection, view, model, time, 0, ALL_PARTICLE_TYPES & ~(1u << dustParticle));
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        renderDustVolumes(projection, view, model, time);
+    }
+    else if (temporalDust) {
+        drawParticles(projection, view, model, time, 0, ALL_PARTICLE_TYPES & ~(1u << dustParticle));
+        renderTemporalDust(projection, view, model, time);
+    }
+    else if (dustDivisor > 1) {
+        drawParticles(projection, view, model, time, 0, ALL_PARTICLE_TYPES & ~(1u << dustParticle));
+        renderLowResDust(projection, view, model, time);
+    }
+    else {
+        drawParticles(projection, view, model, time, 0);
+    }
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    drawImpostors(projection, view);
+    glDisable(GL_BLEND);
+}
+
+void drawScreenQuad() {
+    glBindVertexArray(screenVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void resizeBloom() {
+    for (int i = 0; i < BLOOM_LEVELS; ++i) {
+        bloomLevels[i]->resize(glm::max(framebufferWidth >> (i + 1), 1), glm::max(framebufferHeight >> (i + 1), 1));
+    }
+}
+
+void bloom() {
+    bloomTimer->begin();
+
+    bloomDownsampleShader->use();
+    bloomDownsampleShader->setInt("sourceTexture", 0);
+    bloomDownsampleShader->setFloat("threshold", bloomThreshold);
+    bloomDownsampleShader->setFloat("exposure", exposure);
+    for (int i = 0; i < BLOOM_LEVELS; ++i) {
+        const RenderTarget* source = i == 0 ? hdrTarget : bloomLevels[i - 1];
+        bloomLevels[i]->bind();
+        bloomDownsampleShader->setBool("prefilter", i == 0);
+        bloomDownsampleShader->setVec2("texelSize", glm::vec2(1.0f / source->width, 1.0f / source->height));
+        source->bindTexture(0);
+        drawScreenQuad();
+    }
+
+    // every level keeps its own downsample and gets the blurrier level below added on top
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    bloomUpsampleShader->use();
+    bloomUpsampleShader->setInt("sourceTexture", 0);
+    for (int i = BLOOM_LEVELS - 2; i >= 0; --i) {
+        const RenderTarget* source = bloomLevels[i + 1];
+        bloomLevels[i]->bind();
+        bloomUpsampleShader->setVec2("texelSize", glm::vec2(1.0f / source->width, 1.0f / source->height));
+        source->bindTexture(0);
+        drawScreenQuad();
+    }
+    glDisable(GL_BLEND);
+
+    bloomTimer->end();
+    if (++bloomReportFrame % 60 == 0) {
+        cout << "Bloom: " << bloomTimer->milliseconds << " ms" << endl;
+    }
+}
+
+void tonemap() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+    tonemapShader->use();
+    tonemapShader->setInt("hdrBuffer", 0);
+    tonemapShader->setInt("bloomBuffer", 1);
+    tonemapShader->setFloat("exposure", exposure);
+    tonemapShader->setFloat("bloomIntensity", bloomEnabled ? bloomIntensity : 0.0f);
+    hdrTarget->bindTexture(0);
+    if (bloomEnabled) {
+        bloomLevels[0]->bindTexture(1);
+    }
+    else {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    drawScreenQuad();
+}
+
+// The template layout is fixed for the whole run, so the shaders get it as constants:
+// #defines for source builds, specialization constants for the stages loaded from SPIR-V.
+// The record format changes the buffer declaration, so SPIR-V has one module per format.
+string particleDefines() {
+    return "#define NUM_STARS " + to_string(NUMBER_STAR) + "u\n"
+        "#define NUM_DUST " + to_string(NUMBER_DUST) + "u\n"
+        "#define NUM_H2 " + to_string(NUMBER_H2) + "u\n"
+        "#define NUM_PARTICLES " + to_string(NUMBER_PARTICLE) + "u\n"
+        "#define H2_RATIO " + to_string(H2_RATIO) + "u\n"
+        "#define PARTICLE_WORKGROUP_SIZE " + to_string(PARTICLE_WORKGROUP_SIZE) + "\n" +
+        (packedParticles ? "#define PACKED_PARTICLES\n" : "");
+}
+
+size_t particleRecordSize() {
+    return packedParticles ? sizeof(PackedParticle) : sizeof(Particle);
+}
+
+// Runs particles spanning the generator's ranges through the same packParticle and
+// unpackParticle the shaders use, and reports the worst error the packed format adds.
+void reportPackingError(const ComputeParameters& cParam) {
+    const int STEPS = 64;
+    float positionError = 0.0f, angleError = 0.0f, brightnessError = 0.0f, tempError = 0.0f;
+    // the temperatures before and after packing, what a star's color is looked up from
+    float temps[2][STEPS + 1];
+    for (int i = 0; i <= STEPS; ++i) {
+        float t = (float)i / STEPS;
+        Particle particle;
+        particle.pos = glm::vec2(cParam.maxRad * t, -cParam.maxRad * t * (1.0f - cParam.outExc));
+        particle.rotation = cParam.offset * t;
+        particle.angle = 2.0f * PI * t;
+        particle.height = 100.0f * (t - 0.5f);
+        particle.angleVel = -cParam.speed * sqrt(1.0f / glm::max(particle.pos.x, 1.0f));
+        particle.brightness = glm::mix(cParam.minDustBrightness, cParam.minStarBrightness, t);
+        particle.temp = glm::mix(cParam.minTemp, cParam.maxTemp, t);
+
+        Particle unpacked = gpu::unpackParticle(gpu::packParticle(particle));
+        positionError = glm::max(positionError, glm::length(unpacked.pos - particle.pos));
+        // angles come back reduced to one turn
+        float angleDelta = glm::abs(unpacked.angle - particle.angle);
+        angleError = glm::max(angleError, glm::min(angleDelta, 2.0f * PI - angleDelta));
+        brightnessError = glm::max(brightnessError, glm::abs(unpacked.brightness - particle.brightness) / particle.brightness);
+        tempError = glm::max(tempError, glm::abs(unpacked.temp - particle.temp));
+        temps[0][i] = particle.temp;
+        temps[1][i] = unpacked.temp;
+    }
+
+    float colors[2][3][STEPS + 1];
+    for (int side = 0; side < 2; ++side)
+        blackbodyTable.colors(temps[side], colors[side][0], colors[side][1], colors[side][2], STEPS + 1);
+    float colorError = 0.0f;
+    for (int channel = 0; channel < 3; ++channel) {
+        for (int i = 0; i <= STEPS; ++i)
+            colorError = glm::max(colorError, glm::abs(colors[1][channel][i] - colors[0][channel][i]));
+    }
+    cout << "Packed particles: position error up to " << positionError << ", angle " << angleError
+        << " rad, brightness " << brightnessError * 100.0f << " %, temperature " << tempError << " K (color "
+        << colorError << ")" << endl;
+}
+
+// constant_id order of Particle.glsl and particleProcessor.comp
+vector<pair<GLuint, GLuint>> particleCountConstants() {
+    return { { 0, NUMBER_STAR }, { 1, NUMBER_DUST }, { 2, NUMBER_H2 }, { 3, NUMBER_PARTICLE }, { 4, H2_RATIO }, { 5, PARTICLE_WORKGROUP_SIZE } };
+}
+
+// Startup overlaps the shader compiles with the rest of the setup: every link is submitted
+// without waiting, the buffers, meshes and targets are built, and only then main() waits for
+// the programs still compiling. --serial-startup links each program on creation instead,
+// the baseline to compare against.
+bool parallelStartup = true;
+// load the stages compile_spirv.bat precompiled when the driver supports ARB_gl_spirv,
+// --no-spirv builds everything from source
+bool useSpirv = true;
+chrono::high_resolution_clock::time_point startupBegin;
+chrono::high_resolution_clock::time_point startupPhaseBegin;
+
+void startupPhase(const char* name) {
+    auto now = chrono::high_resolution_clock::now();
+    cout << "Startup: " << name << " " << chrono::duration<double, milli>(now - startupPhaseBegin).count() << " ms ("
+        << chrono::duration<double, milli>(now - startupBegin).count() << " ms total)" << endl;
+    startupPhaseBegin = now;
+}
 
 void init() {
+    // decoded on a worker thread while the window opens and the shaders compile
+    sprites = new SpriteArray(spritePaths, SPRITE_SIZE, proceduralSprite);
+
     window = windowUtil->InitWindowV43(VIEW_PORT_WIDTH, VIEW_PORT_HEIGHT, "dProxy_window", NULL, NULL);
-    glEnable(GL_DEPTH_TEST);
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    shaderReloader = new ShaderReloader(window, ".");
+    Shader::globalDefines() = particleDefines();
+    if (useSpirv) {
+        Shader::specializationConstants() = particleCountConstants();
+        Shader::enableSpirv((GLADloadproc)glfwGetProcAddress, "spirv/");
+        cout << "SPIR-V shaders " << (Shader::spirvDirectory().empty() ? "not supported, compiling from source" : "enabled") << endl;
+    }
+    startupPhase("window");
 
-    galaxyShader = new Shader("GalaxyShader.vs", "GalaxyShader.frag");
-    computeShader = new Shader("./particleProcessor.comp");
+    if (parallelStartup) {
+        Shader::enableParallelCompile((GLADloadproc)glfwGetProcAddress);
+        Shader::deferredLinking() = true;
+    }
+
+    vector<string> variantManifest = ShaderVariants::readManifest("shader_variants.txt");
+    for (ParticlePass& pass : particlePasses) {
+        pass.programs = new ShaderVariants("GalaxyShader.vs", "GalaxyShader.frag", pass.name, variantFeatures, shaderReloader);
+        pass.programs->precompile(variantManifest);
+    }
+    computeShader = shaderReloader->watch(new Shader("./particleProcessor.comp"));
+    classifyShader = shaderReloader->watch(new Shader("./ParticleClassify.comp"));
+    tonemapShader = shaderReloader->watch(new Shader("ScreenQuad.vs", "Tonemap.frag"));
+    oitResolveShader = shaderReloader->watch(new Shader("ScreenQuad.vs", "OitResolve.frag"));
+    bloomDownsampleShader = shaderReloader->watch(new Shader("ScreenQuad.vs", "Bloom.frag", "#define BLOOM_DOWNSAMPLE\n"));
+    bloomUpsampleShader = shaderReloader->watch(new Shader("ScreenQuad.vs", "Bloom.frag", "#define BLOOM_UPSAMPLE\n"));
+    dustUpsampleShader = shaderReloader->watch(new Shader("ScreenQuad.vs", "DustUpsample.frag"));
+    volumeSplatShader = shaderReloader->watch(Shader::createCompute("./DustVolume.comp", "#define VOLUME_SPLAT\n"));
+    volumeClearShader = shaderReloader->watch(Shader::createCompute("./DustVolume.comp", "#define VOLUME_CLEAR\n"));
+    volumeClearOccupancyShader = shaderReloader->watch(Shader::createCompute("./DustVolume.comp", "#define VOLUME_CLEAR_OCCUPANCY\n"));
+    volumeResolveShader = shaderReloader->watch(Shader::createCompute("./DustVolume.comp", "#define VOLUME_RESOLVE\n"));
+    volumeMarchShader = shaderReloader->watch(new Shader("DustVolume.vs", "DustVolume.frag"));
+    impostorShader = shaderReloader->watch(new Shader("Impostor.vs", "Impostor.frag"));
+    temporalCompositeShader = shaderReloader->watch(new Shader("ScreenQuad.vs", "TemporalDust.frag"));
+    overdrawClearShader = shaderReloader->watch(Shader::createCompute("./Overdraw.comp", "#define OVERDRAW_CLEAR\n"));
+    overdrawReduceShader = shaderReloader->watch(Shader::createCompute("./Overdraw.comp", "#define OVERDRAW_REDUCE\n"));
+    overdrawHeatmapShader = shaderReloader->watch(new Shader("ScreenQuad.vs", "Overdraw.frag"));
+    sortedParticleShader = shaderReloader->watch(new Shader("GalaxyShader.vs", "GalaxyShader.frag", "#define SORTED_PASS\n"));
+    depthKeyShader = shaderReloader->watch(new Shader("./DepthKeys.comp"));
+    radixHistogramShader = shaderReloader->watch(Shader::createCompute("./RadixSort.comp", "#define RADIX_HISTOGRAM\n"));
+    radixScanShader = shaderReloader->watch(Shader::createCompute("./RadixSort.comp", "#define RADIX_SCAN\n"));
+    radixScatterShader = shaderReloader->watch(Shader::createCompute("./RadixSort.comp", "#define RADIX_SCATTER\n"));
+    Shader::deferredLinking() = false;
+    startupPhase(parallelStartup ? "shader submission" : "shader compilation");
 
     //user input
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    startupBegin = startupPhaseBegin = chrono::high_resolution_clock::now();
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--serial-startup")
+            parallelStartup = false;
+        else if (string(argv[i]) == "--no-spirv")
+            useSpirv = false;
+        else if (string(argv[i]) == "--packed-particles")
+            packedParticles = true;
+    }
     init();
+    cout << "Program binary cache: " << ProgramBinaryCache::hits() << " hits, " << ProgramBinaryCache::misses() << " compiled from source" << endl;
     //render mode
     RenderMode renderMode = fillMode;
 
     unsigned int particleSsbo;
     glGenBuffers(1, &particleSsbo);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSsbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, (sizeof(Particle) + 8) * NUMBER_PARTICLE, particles, GL_STATIC_DRAW);
-
-    unsigned int particlesIndex = glGetUniformBlockIndex(computeShader->ID, "Particles");
-    glUniformBlockBinding(computeShader->ID, particlesIndex, 2);
-
-    particlesIndex = glGetUniformBlockIndex(galaxyShader->ID, "Particles");
-    glUniformBlockBinding(galaxyShader->ID, particlesIndex, 2);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, particleRecordSize() * NUMBER_PARTICLE * NUMBER_TEMPLATE, NULL, GL_STATIC_DRAW);
 
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, particleSsbo);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
@@ -177,7 +1729,6 @@ int main()
     cParam.outExcDiv = 1 - cParam.outExc;
     cParam.bugleRad = 500;
     cParam.speed = 7.0f;
-    cParam.numStarts = NUMBER_STAR;
     cParam.minDustBrightness = 0.001f;
     cParam.maxDustBrightness = 0.005f;
     cParam.maxStarBrightness = 0.1f;
@@ -195,9 +1746,10 @@ int main()
     VertexParams vParam;
     vParam.starScale = 14.5f;
     vParam.dustScale = 22.4f;
-    vParam.numStarts = NUMBER_STAR;
     vParam.h2Distance = 100;
     vParam.h2Size = 23;
+    vParam.blackbodyMinTemp = BLACKBODY_MIN_TEMP;
+    vParam.blackbodyMaxTemp = BLACKBODY_MAX_TEMP;
 
     unsigned int vertexParams;
     glGenBuffers(1, &vertexParams);
@@ -205,46 +1757,89 @@ int main()
     glBufferData(GL_UNIFORM_BUFFER, sizeof(VertexParams), &vParam, GL_STATIC_DRAW);
     glBindBufferBase(GL_UNIFORM_BUFFER, 5, vertexParams);
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSsbo);
+    // both stay bound for the whole run, no other pass uses these units
+    glActiveTexture(GL_TEXTURE0 + SPRITE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, sprites->upload());
+    glActiveTexture(GL_TEXTURE0 + BLACKBODY_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_1D, blackbodyTable.upload());
+    glActiveTexture(GL_TEXTURE0);
 
-    computeShader->use();
-    glDispatchCompute(NUMBER_PARTICLE/250, 1, 1);
-
-    // make sure writing to image has finished before read
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-    glUseProgram(0);
+    SphereInit();
+    // points fetch everything from the Particles buffer, the VAO only carries the galaxy ID
+    glGenVertexArrays(1, &pointVAO);
+
+    initGalaxyBuffers();
+    bindGalaxyIdAttribute(sphereVAO);
+    bindGalaxyIdAttribute(pointVAO);
+
+    // all classes share the sphere for now, but each pass can pick its own mesh
+    for (ParticlePass& pass : particlePasses) {
+        pass.vao = sphereVAO;
+        pass.indexCount = indexCount;
+        pass.primitive = GL_TRIANGLE_STRIP;
+    }
 
+    buildScene(clusterView);
+    buildDrawCommands();
+
+    frameTimer = new GpuTimer();
+    sortTimer = new GpuTimer();
+    bloomTimer = new GpuTimer();
+
+    hdrTarget = new RenderTarget({ GL_RGBA16F });
+    // revealage is a product of many 1 - alpha factors close to 1, 8 bits would round them away
+    oitTarget = new RenderTarget({ GL_RGBA16F, GL_R16F });
+    dustTarget = new RenderTarget({ GL_RGBA16F });
+    initDustVolumes();
+    initImpostors();
+    for (RenderTarget*& slice : temporalSlices) {
+        slice = new RenderTarget({ GL_RGBA16F });
+    }
+    initOverdraw();
+    resetImpostors();
+    for (RenderTarget*& level : bloomLevels) {
+        level = new RenderTarget({ GL_RGBA16F });
+    }
+    glGenVertexArrays(1, &screenVAO);
+    startupPhase("buffers, meshes and targets");
 
+    // the driver kept compiling during the setup above, whatever is left is waited for here
+    size_t stillCompiling = Shader::finishCompletedLinks();
+    Shader::finishAllLinks();
+    startupPhase(("waiting for " + to_string(stillCompiling) + " programs").c_str());
+    checkLayouts();
+    checkBlackbodyTable();
 
-    SphereInit();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSsbo);
+    generateParticles(cParam, computeParams);
+    startupPhase("particle generation");
+    if (packedParticles)
+        reportPackingError(cParam);
+    bool firstFrame = true;
 
     //render loop
 
-    while (!close)
+    while (!closeRequested)
     {
-        glm::mat4 projection = glm::perspective(glm::radians(camera->Zoom), (float)VIEW_PORT_WIDTH / (float)VIEW_PORT_HEIGHT, 0.1f, 100000.0f);
-        galaxyShader->use();
-        galaxyShader->setMat4("projection", projection);
-        //hot reaload
-        if (glfwGetKey(window, GLFW_KEY_R)) {
-            computeShader->reloadComputeShaderProgram("./particleProcessor.comp");
-            computeShader->use();
-            glDispatchCompute(NUMBER_PARTICLE / 256, 1, 1);
-
-            // make sure writing to image has finished before read
-            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-            glUseProgram(0);
-
-            galaxyShader->reloadShaderProgram("GalaxyShader.vs", "GalaxyShader.frag");
+        //hot reaload, saved shader files are picked up by the watcher and R rebuilds everything
+        if (keyPressed(GLFW_KEY_R)) {
+            shaderReloader->requestAll();
+        }
+        for (Shader* reloaded : shaderReloader->poll()) {
+            if (reloaded == computeShader) {
+                generateParticles(cParam, computeParams);
+            }
+            volumeDirty = true;
+            resetImpostors();
+            validSlices = 0;
+            frameDirty = true;
         }
 
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        glClearColor(0.001f, 0.001f, 0.001f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
+        RenderMode previousRenderMode = renderMode;
         if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
             renderMode = wireframeMode;
         }
@@ -254,38 +1849,149 @@ int main()
         if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS) {
             renderMode = fillMode;
         }
+        if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) {
+            renderMode = overdrawMode;
+        }
+        if (renderMode != previousRenderMode) {
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_P)) {
+            pointSplatting = !pointSplatting;
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_G)) {
+            clusterView = !clusterView;
+            buildScene(clusterView);
+            resetImpostors();
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_F)) {
+            governor.enabled = !governor.enabled;
+            cout << "Frame governor " << (governor.enabled ? "on" : "off") << endl;
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_T)) {
+            paused = !paused;
+            frameDirty = true;
+        }
+        if (glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_PRESS) {
+            exposure *= 1.0f + deltaTime;
+            frameDirty = true;
+        }
+        if (glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_PRESS) {
+            exposure /= 1.0f + deltaTime;
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_O)) {
+            compositeMode = (CompositeMode)((compositeMode + 1) % compositeModeCount);
+            cout << "Composite mode: " << compositeModeNames[compositeMode] << endl;
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_C)) {
+            cpuSort = !cpuSort;
+            cout << "Depth sort on the " << (cpuSort ? "CPU" : "GPU") << endl;
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_B)) {
+            bloomEnabled = !bloomEnabled;
+            cout << "Bloom " << (bloomEnabled ? "on" : "off") << endl;
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_L)) {
+            dustDivisor = dustDivisor == 4 ? 1 : dustDivisor * 2;
+            cout << "Dust resolution 1/" << dustDivisor << (compositeMode == additiveComposite ? "" : " (additive mode only)") << endl;
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_V)) {
+            volumetricDust = !volumetricDust;
+            cout << "Volumetric dust " << (volumetricDust ? "on" : "off") << (compositeMode == additiveComposite ? "" : " (additive mode only)") << endl;
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_K)) {
+            impostorsEnabled = !impostorsEnabled;
+            cout << "Impostors " << (impostorsEnabled ? "on" : "off") << (compositeMode == additiveComposite ? "" : " (additive mode only)") << endl;
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_N)) {
+            temporalDust = !temporalDust;
+            validSlices = 0;
+            cout << "Temporal dust " << (temporalDust ? "on" : "off") << (compositeMode == additiveComposite ? "" : " (additive mode only)") << endl;
+            frameDirty = true;
+        }
+        if (keyPressed(GLFW_KEY_I)) {
+            idleMode = !idleMode;
+            cout << "Idle mode " << (idleMode ? "on" : "off") << endl;
+        }
+        closeRequested = windowUtil->processInput(window, camera, deltaTime);
 
-        switch (renderMode) {
-        case fillMode:
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); // el modo wireframe
-            break;
-        case pointMode:
-            glPolygonMode(GL_FRONT_AND_BACK, GL_POINT); // el modo wireframe
-            break;
-        case wireframeMode:
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); // el modo wireframe
-            break;
-        default:
-            break;
+        if (!paused) {
+            simulationTime += deltaTime;
         }
-        close = windowUtil->processInput(window, camera, deltaTime);
 
-        galaxyShader->use();
-        glm::mat4 view = camera->GetViewMatrix();
-        galaxyShader->setMat4("view", view);
-        galaxyShader->setVec3("camPos", camera->Position);
+        CameraState cameraState = CameraState::from(camera);
+        bool dirty = frameDirty || !paused || !(cameraState == lastCameraState);
+        if (temporalDust && compositeMode == additiveComposite) {
+            // the history needs a few more frames to fill in the dust that was not drawn yet
+            if (dirty)
+                temporalSettle = TEMPORAL_SETTLE_FRAMES;
+            else if (temporalSettle > 0) {
+                --temporalSettle;
+                dirty = true;
+            }
+        }
+        if (idleMode && !dirty) {
+            // the last presented frame stays on screen, sleep until something happens
+            glfwWaitEventsTimeout(IDLE_WAIT_SECONDS);
+            // the wait must not show up as a huge step in the next frame's movement
+            lastFrame = glfwGetTime();
+            continue;
+        }
+        frameDirty = false;
+        lastCameraState = cameraState;
+
+        // the GPU timer lags a few frames behind, fall back to the CPU frame time until it reports
+        governor.update(frameTimer->hasResult() ? (float)frameTimer->milliseconds : deltaTime * 1000.0f);
+        // minimized, nothing to draw into
+        if (framebufferWidth == 0 || framebufferHeight == 0) {
+            glfwWaitEvents();
+            continue;
+        }
 
-        float time = glfwGetTime();
+        glm::mat4 projection = glm::perspective(glm::radians(camera->Zoom), (float)framebufferWidth / (float)framebufferHeight, 0.1f, 100000.0f);
+        glm::mat4 view = camera->GetViewMatrix();
         glm::mat4 model = glm::mat4(1.0f);
-        galaxyShader->setMat4("model", model);
-        galaxyShader->setFloat("time", time);
-        glBindVertexArray(sphereVAO);
-        glDrawElementsInstanced(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0, NUMBER_PARTICLE);
+        applyParticleBudget(governor.budget);
+        updateImpostors(projection, model, simulationTime);
+        buildDrawCommands();
+        hdrTarget->resize(framebufferWidth, framebufferHeight);
+        if (compositeMode == oitComposite) {
+            oitTarget->resize(framebufferWidth, framebufferHeight);
+        }
+
+        frameTimer->begin();
+        renderGalaxy(projection, view, model, simulationTime, renderMode);
+        if (renderMode == overdrawMode) {
+            showOverdraw();
+        }
+        else {
+            if (bloomEnabled) {
+                resizeBloom();
+                bloom();
+            }
+            tonemap();
+        }
+        frameTimer->end();
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+        if (firstFrame) {
+            glFinish();
+            startupPhase("first frame");
+            firstFrame = false;
+        }
 
     }
+    delete shaderReloader;
     glfwTerminate();
     return 0;
 }
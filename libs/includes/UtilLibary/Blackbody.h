@@ -0,0 +1,178 @@
+#ifndef BLACKBODY_H
+#define BLACKBODY_H
+
+#include <glad43/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLACKBODY_SSE2
+#endif
+
+// The color of a black body by temperature, as a table built by the compiler: Planck's law
+// integrated against the CIE 1931 color matching functions (the multi-lobe Gaussian fit of
+// Wyman, Sloan and Shirley), converted to linear sRGB, negative channels clamped and the
+// largest channel scaled to 1. Entry i is the color at
+// minTemp + i * (maxTemp - minTemp) / (SIZE - 1).
+namespace blackbody {
+
+// std::exp is not constexpr: halve x into [-0.5, 0.5], sum the series, square back up
+constexpr double constexprExp(double x) {
+    int halvings = 0;
+    while (x > 0.5 || x < -0.5) {
+        x *= 0.5;
+        ++halvings;
+    }
+    double term = 1.0;
+    double sum = 1.0;
+    for (int n = 1; n < 12; ++n) {
+        term *= x / n;
+        sum += term;
+    }
+    for (; halvings > 0; --halvings)
+        sum *= sum;
+    return sum;
+}
+
+// one lobe of the matching function fit, with a different width on each side of the peak
+constexpr double lobe(double wavelength, double peak, double widthBelow, double widthAbove) {
+    double t = (wavelength - peak) / (wavelength < peak ? widthBelow : widthAbove);
+    return constexprExp(-0.5 * t * t);
+}
+
+template <int SIZE>
+struct Table {
+    float minTemp;
+    float maxTemp;
+    float rgb[SIZE][3];
+
+    // nearest entries blended, the same result the linearly filtered texture gives
+    glm::vec3 color(float temp) const {
+        float position = std::min(std::max((temp - minTemp) / (maxTemp - minTemp), 0.0f), 1.0f) * (SIZE - 1);
+        int index = std::min((int)position, SIZE - 2);
+        float blend = position - index;
+        return glm::mix(glm::vec3(rgb[index][0], rgb[index][1], rgb[index][2]),
+            glm::vec3(rgb[index + 1][0], rgb[index + 1][1], rgb[index + 1][2]), blend);
+    }
+
+    // color() for many temperatures, written as separate channels. With SSE2 the positions
+    // and the blend run four at a time, only fetching the table entries stays per lane.
+    void colors(const float* temps, float* red, float* green, float* blue, size_t count) const {
+        size_t i = 0;
+#if defined(BLACKBODY_SSE2)
+        const __m128 minimum = _mm_set1_ps(minTemp);
+        const __m128 scale = _mm_set1_ps((SIZE - 1) / (maxTemp - minTemp));
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 last = _mm_set1_ps((float)(SIZE - 1));
+        const __m128i lastStart = _mm_set1_epi32(SIZE - 2);
+        for (; i + 4 <= count; i += 4) {
+            __m128 position = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(temps + i), minimum), scale);
+            position = _mm_min_ps(_mm_max_ps(position, zero), last);
+            __m128i index = _mm_cvttps_epi32(position);
+            // SSE2 has no integer min; at the top end the last pair blends at weight 1
+            __m128i beyond = _mm_cmpgt_epi32(index, lastStart);
+            index = _mm_or_si128(_mm_and_si128(beyond, lastStart), _mm_andnot_si128(beyond, index));
+            __m128 blend = _mm_sub_ps(position, _mm_cvtepi32_ps(index));
+
+            alignas(16) int lanes[4];
+            _mm_store_si128((__m128i*)lanes, index);
+            __m128 channels[2][3];
+            for (int side = 0; side < 2; ++side) {
+                for (int channel = 0; channel < 3; ++channel) {
+                    channels[side][channel] = _mm_set_ps(rgb[lanes[3] + side][channel], rgb[lanes[2] + side][channel],
+                        rgb[lanes[1] + side][channel], rgb[lanes[0] + side][channel]);
+                }
+            }
+
+            float* outputs[3] = { red, green, blue };
+            for (int channel = 0; channel < 3; ++channel) {
+                __m128 from = channels[0][channel];
+                __m128 to = channels[1][channel];
+                _mm_storeu_ps(outputs[channel] + i, _mm_add_ps(from, _mm_mul_ps(_mm_sub_ps(to, from), blend)));
+            }
+        }
+#endif
+        for (; i < count; ++i) {
+            glm::vec3 value = color(temps[i]);
+            red[i] = value.r;
+            green[i] = value.g;
+            blue[i] = value.b;
+        }
+    }
+
+    // RGB16F 1D texture with linear filtering. The entries sit on texel centers, so a lookup
+    // samples at (t * (SIZE - 1) + 0.5) / SIZE for t in [0, 1] across the temperature range.
+    unsigned int upload() const {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_1D, texture);
+        glTexStorage1D(GL_TEXTURE_1D, 1, GL_RGB16F, SIZE);
+        glTexSubImage1D(GL_TEXTURE_1D, 0, 0, SIZE, GL_RGB, GL_FLOAT, rgb);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_1D, 0);
+        return texture;
+    }
+};
+
+// Evaluated by the compiler when assigned to a constexpr variable. That takes a few million
+// steps for a couple hundred entries, beyond MSVC's default /constexpr:steps.
+template <int SIZE>
+constexpr Table<SIZE> makeTable(float minTemp, float maxTemp) {
+    static_assert(SIZE >= 2, "a blackbody table needs both ends of its range");
+
+    // 380 to 780 nm in 10 nm steps, the matching functions do not depend on the temperature
+    const int SAMPLES = 41;
+    double xBar[SAMPLES] = {};
+    double yBar[SAMPLES] = {};
+    double zBar[SAMPLES] = {};
+    for (int s = 0; s < SAMPLES; ++s) {
+        double nanometers = 380.0 + 10.0 * s;
+        xBar[s] = 1.056 * lobe(nanometers, 599.8, 37.9, 31.0) + 0.362 * lobe(nanometers, 442.0, 16.0, 26.7)
+            - 0.065 * lobe(nanometers, 501.1, 20.4, 26.2);
+        yBar[s] = 0.821 * lobe(nanometers, 568.8, 46.9, 40.5) + 0.286 * lobe(nanometers, 530.9, 16.3, 31.1);
+        zBar[s] = 1.217 * lobe(nanometers, 437.0, 11.8, 36.0) + 0.681 * lobe(nanometers, 459.0, 26.0, 13.8);
+    }
+
+    // second radiation constant in m*K, the first one cancels in the normalization
+    const double C2 = 1.438776877e-2;
+
+    Table<SIZE> table{};
+    table.minTemp = minTemp;
+    table.maxTemp = maxTemp;
+    for (int i = 0; i < SIZE; ++i) {
+        double temp = minTemp + (double)(maxTemp - minTemp) * i / (SIZE - 1);
+        double X = 0.0, Y = 0.0, Z = 0.0;
+        for (int s = 0; s < SAMPLES; ++s) {
+            double meters = (380.0 + 10.0 * s) * 1e-9;
+            double radiance = 1.0 / (meters * meters * meters * meters * meters * (constexprExp(C2 / (meters * temp)) - 1.0));
+            X += radiance * xBar[s];
+            Y += radiance * yBar[s];
+            Z += radiance * zBar[s];
+        }
+
+        double rgb[3] = {
+            3.2406 * X - 1.5372 * Y - 0.4986 * Z,
+            -0.9689 * X + 1.8758 * Y + 0.0415 * Z,
+            0.0557 * X - 0.2040 * Y + 1.0570 * Z
+        };
+        double largest = 0.0;
+        for (int channel = 0; channel < 3; ++channel) {
+            if (rgb[channel] < 0.0)
+                rgb[channel] = 0.0;
+            if (rgb[channel] > largest)
+                largest = rgb[channel];
+        }
+        for (int channel = 0; channel < 3; ++channel)
+            table.rgb[i][channel] = (float)(rgb[channel] / largest);
+    }
+    return table;
+}
+
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad43/glad.h>
+
+// Measures the GPU time spent between begin() and end() with a pair of timestamp queries.
+// Timestamps (unlike GL_TIME_ELAPSED) can be nested, so several timers can run inside the same frame.
+// Results are read a few frames late so the CPU never waits for the GPU.
+class GpuTimer
+{
+public:
+    static const int LATENCY = 4;
+
+    // last measured time in milliseconds, 0 until the first result arrives
+    double milliseconds;
+
+    GpuTimer() : milliseconds(0.0), frame(0), valid(false) {
+        glGenQueries(2 * LATENCY, queries);
+    }
+
+    ~GpuTimer() {
+        glDeleteQueries(2 * LATENCY, queries);
+    }
+
+    void begin() {
+        glQueryCounter(queries[2 * (frame % LATENCY)], GL_TIMESTAMP);
+    }
+
+    void end() {
+        glQueryCounter(queries[2 * (frame % LATENCY) + 1], GL_TIMESTAMP);
+        ++frame;
+        poll();
+    }
+
+    // true once at least one measurement is available
+    bool hasResult() const {
+        return valid;
+    }
+
+private:
+    unsigned int queries[2 * LATENCY];
+    unsigned int frame;
+    bool valid;
+
+    void poll() {
+        if (frame < LATENCY)
+            return;
+
+        // the oldest pair is the one begin() will overwrite next
+        int slot = frame % LATENCY;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[2 * slot + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        GLuint64 start, stop;
+        glGetQueryObjectui64v(queries[2 * slot], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[2 * slot + 1], GL_QUERY_RESULT, &stop);
+        milliseconds = (stop - start) / 1000000.0;
+        valid = true;
+    }
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include <glad43/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+// Linked program binaries stored in shader_cache/, one file per program. The file name is
+// a hash of every stage's final source and of the driver's vendor, renderer and version
+// strings, so an edited shader or a driver update simply misses. A binary the driver
+// rejects counts as a miss too and gets overwritten after the next source build.
+class ProgramBinaryCache
+{
+public:
+    // header only, so the counters live in function statics
+    static unsigned int& hits() {
+        static unsigned int count = 0;
+        return count;
+    }
+
+    static unsigned int& misses() {
+        static unsigned int count = 0;
+        return count;
+    }
+
+    static bool supported() {
+        static GLint formats = -1;
+        if (formats < 0)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    static string key(const vector<const char*>& sources) {
+        uint64_t hash = 14695981039346656037ull;
+        const GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : driverStrings)
+            hash = fnv1a(hash, (const char*)glGetString(name));
+        for (const char* source : sources)
+            hash = fnv1a(hash, source);
+
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+        return text;
+    }
+
+    // a linked program, or 0 when there is no usable binary
+    static GLuint load(const string& key) {
+        if (!supported())
+            return 0;
+
+        ifstream file(path(key), ios::binary);
+        GLenum format = 0;
+        uint32_t length = 0;
+        if (!file.read((char*)&format, sizeof(format)) || !file.read((char*)&length, sizeof(length))) {
+            ++misses();
+            return 0;
+        }
+        vector<char> binary(length);
+        if (!file.read(binary.data(), length)) {
+            ++misses();
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, format, binary.data(), (GLsizei)length);
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            ++misses();
+            return 0;
+        }
+        ++hits();
+        return program;
+    }
+
+    // call glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE) before linking
+    static void store(const string& key, GLuint program) {
+        if (!supported())
+            return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+        makeDirectory();
+        ofstream file(path(key), ios::binary | ios::trunc);
+        uint32_t size = (uint32_t)length;
+        file.write((const char*)&format, sizeof(format));
+        file.write((const char*)&size, sizeof(size));
+        file.write(binary.data(), length);
+        if (!file)
+            cout << "ERROR::PROGRAM_CACHE::WRITE_FAILED " << path(key) << endl;
+    }
+
+private:
+    static uint64_t fnv1a(uint64_t hash, const char* text) {
+        if (text) {
+            for (; *text; ++text) {
+                hash ^= (unsigned char)*text;
+                hash *= 1099511628211ull;
+            }
+        }
+        // separator, so moving text from one string to the next changes the hash
+        hash ^= 0xff;
+        return hash * 1099511628211ull;
+    }
+
+    static const char* directory() {
+        return "shader_cache";
+    }
+
+    static string path(const string& key) {
+        return string(directory()) + "/" + key + ".bin";
+    }
+
+    static void makeDirectory() {
+#ifdef _WIN32
+        _mkdir(directory());
+#else
+        mkdir(directory(), 0755);
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+using namespace std;
+
+// Stable LSD radix sort of 32-bit keys carrying a 32-bit value, 8 bits per pass.
+// Every pass splits the input in one contiguous chunk per thread: each thread counts its
+// chunk, the counts are scanned digit by digit across threads, then each thread scatters
+// its chunk to its own offsets, which keeps equal keys in input order.
+inline void radixSortParallel(vector<uint32_t>& keys, vector<uint32_t>& values, unsigned int threadCount = 0) {
+    const unsigned int RADIX = 256;
+    size_t count = keys.size();
+    if (count == 0)
+        return;
+
+    if (threadCount == 0)
+        threadCount = max(1u, thread::hardware_concurrency());
+    threadCount = (unsigned int)min<size_t>(threadCount, (count + 4095) / 4096);
+    threadCount = max(1u, threadCount);
+
+    vector<uint32_t> keysTemp(count);
+    vector<uint32_t> valuesTemp(count);
+    vector<size_t> offsets(threadCount * RADIX);
+    size_t chunk = (count + threadCount - 1) / threadCount;
+
+    uint32_t* keysIn = keys.data();
+    uint32_t* valuesIn = values.data();
+    uint32_t* keysOut = keysTemp.data();
+    uint32_t* valuesOut = valuesTemp.data();
+
+    auto runThreads = [&](auto work) {
+        vector<thread> threads;
+        for (unsigned int t = 1; t < threadCount; ++t)
+            threads.emplace_back(work, t);
+        work(0);
+        for (thread& worker : threads)
+            worker.join();
+    };
+
+    for (unsigned int shift = 0; shift < 32; shift += 8) {
+        runThreads([&](unsigned int t) {
+            size_t* histogram = &offsets[t * RADIX];
+            fill(histogram, histogram + RADIX, 0);
+            size_t end = min(count, (t + 1) * chunk);
+            for (size_t i = t * chunk; i < end; ++i)
+                ++histogram[(keysIn[i] >> shift) & (RADIX - 1)];
+        });
+
+        // exclusive scan, digit major so thread t writes after every earlier thread
+        size_t running = 0;
+        for (unsigned int digit = 0; digit < RADIX; ++digit) {
+            for (unsigned int t = 0; t < threadCount; ++t) {
+                size_t value = offsets[t * RADIX + digit];
+                offsets[t * RADIX + digit] = running;
+                running += value;
+            }
+        }
+
+        runThreads([&](unsigned int t) {
+            size_t* offset = &offsets[t * RADIX];
+            size_t end = min(count, (t + 1) * chunk);
+            for (size_t i = t * chunk; i < end; ++i) {
+                size_t destination = offset[(keysIn[i] >> shift) & (RADIX - 1)]++;
+                keysOut[destination] = keysIn[i];
+                valuesOut[destination] = valuesIn[i];
+            }
+        });
+
+        swap(keysIn, keysOut);
+        swap(valuesIn, valuesOut);
+    }
+
+    // four passes, so the sorted data ended up back in the caller's vectors
+}
+
+#endif
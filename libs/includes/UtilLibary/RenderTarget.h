@@ -0,0 +1,109 @@
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+
+#include <glad43/glad.h>
+
+#include <vector>
+#include <iostream>
+
+using namespace std;
+
+// A framebuffer with one immutable texture per color attachment and an optional depth texture.
+// resize() recreates the textures when the size changes, so it can be called every frame.
+class RenderTarget
+{
+public:
+    unsigned int FBO;
+    vector<unsigned int> colorTextures;
+    unsigned int depthTexture;
+    int width;
+    int height;
+
+    RenderTarget(const vector<GLenum>& _colorFormats, bool _withDepth = false, GLenum _filter = GL_LINEAR)
+        : FBO(0), depthTexture(0), width(0), height(0), colorFormats(_colorFormats), withDepth(_withDepth), filter(_filter) {
+    }
+
+    ~RenderTarget() {
+        release();
+    }
+
+    // returns true when the textures had to be recreated
+    bool resize(int _width, int _height) {
+        if (_width == width && _height == height && FBO != 0)
+            return false;
+        if (_width <= 0 || _height <= 0)
+            return false;
+
+        release();
+        width = _width;
+        height = _height;
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+        vector<GLenum> drawBuffers;
+        for (size_t i = 0; i < colorFormats.size(); ++i) {
+            unsigned int texture = createTexture(colorFormats[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)i, GL_TEXTURE_2D, texture, 0);
+            colorTextures.push_back(texture);
+            drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)i);
+        }
+        glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+
+        if (withDepth) {
+            depthTexture = createTexture(GL_DEPTH_COMPONENT32F);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        }
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::FRAMEBUFFER::NOT_COMPLETE" << endl;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return true;
+    }
+
+    void bind() const {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+    }
+
+    void bindTexture(unsigned int unit, size_t attachment = 0) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, colorTextures[attachment]);
+    }
+
+    void release() {
+        if (FBO == 0)
+            return;
+
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteTextures((GLsizei)colorTextures.size(), colorTextures.data());
+        if (depthTexture != 0)
+            glDeleteTextures(1, &depthTexture);
+
+        FBO = 0;
+        depthTexture = 0;
+        colorTextures.clear();
+        width = 0;
+        height = 0;
+    }
+
+private:
+    vector<GLenum> colorFormats;
+    bool withDepth;
+    GLenum filter;
+
+    unsigned int createTexture(GLenum internalFormat) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+};
+
+#endif
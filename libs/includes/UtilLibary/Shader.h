@@ -2,25 +2,77 @@
 #define SHADER_H
 
 #include <glad43/glad.h> // include glad to get all the required OpenGL headers
+#include <UtilLibary/ProgramBinaryCache.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 using namespace std;
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_SHADER_BINARY_FORMAT_SPIR_V_ARB
+#define GL_SHADER_BINARY_FORMAT_SPIR_V_ARB 0x9551
+#endif
+
+// Index of a uniform name in a table shared by every program, see Shader::handle().
+struct UniformHandle {
+    unsigned int index;
+};
+
 class Shader
 {
 public:
     // the program ID
     unsigned int ID;
     unsigned int reloadedProgramID;
+    // lines injected after #version in every stage, used to build specialized programs
+    string defines;
+    // files the program is built from: compute, vertex + fragment, or vertex + fragment + tcs + tes
+    vector<string> sourcePaths;
+    // files pulled in through #include, source string n in a compile error is includedPaths[n - 1]
+    vector<string> includedPaths;
+    // loaded from SPIR-V, see spirvDirectory()
+    bool precompiled = false;
+
+    // lines injected after #version in every program, ahead of the per program defines
+    static string& globalDefines() {
+        static string lines;
+        return lines;
+    }
+
     // constructor reads and builds the shader
-    Shader(const char* vertexPath, const char* fragmentPath) {
+    Shader(const char* vertexPath, const char* fragmentPath) : sourcePaths({ vertexPath, fragmentPath }) {
+        if (loadSpirv())
+            return;
+
+        string vertexCode = readFile(vertexPath);
+        string fragmentCode = readFile(fragmentPath);
+
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+
+        ID = createShaderProgram(vShaderCode, fShaderCode);
+        finishConstruction();
+    }
+
+    // same as above but every stage is compiled with the given #define lines
+    Shader(const char* vertexPath, const char* fragmentPath, const string& _defines) : defines(_defines), sourcePaths({ vertexPath, fragmentPath }) {
+        if (loadSpirv())
+            return;
+
         string vertexCode = readFile(vertexPath);
         string fragmentCode = readFile(fragmentPath);
 
@@ -28,10 +80,11 @@ public:
         const char* fShaderCode = fragmentCode.c_str();
 
         ID = createShaderProgram(vShaderCode, fShaderCode);
+        finishConstruction();
     }
 
     Shader(const char* vertexPath, const char* fragmentPath,
-        const char* tcsPath, const char* tesPath) {
+        const char* tcsPath, const char* tesPath) : sourcePaths({ vertexPath, fragmentPath, tcsPath, tesPath }) {
         string vertexCode = readFile(vertexPath);
         string fragmentCode = readFile(fragmentPath);
         string tcsCode = readFile(tcsPath);
@@ -43,249 +96,548 @@ public:
         const char* tesShaderCode = tesCode.c_str();
 
         ID = createTellShaderProgram(vShaderCode, fShaderCode, tcsShaderCode, tesShaderCode);
+        finishConstruction();
     }
 
-    Shader(const char* computePath) {
+    Shader(const char* computePath) : sourcePaths({ computePath }) {
+        if (loadSpirv())
+            return;
+
         string computeCode = readFile(computePath);
 
         const char* computeShaderCode = computeCode.c_str();
 
         ID = createComputeShaderProgram(computeShaderCode);
+        finishConstruction();
     }
 
-    // use/activate the shader
+    // compute program compiled with the given #define lines
+    static Shader* createCompute(const char* computePath, const string& _defines) {
+        Shader* shader = new Shader();
+        shader->defines = _defines;
+        shader->sourcePaths = { computePath };
+        if (shader->loadSpirv())
+            return shader;
+
+        string computeCode = shader->readFile(computePath);
+        shader->ID = shader->createComputeShaderProgram(computeCode.c_str());
+        shader->finishConstruction();
+        return shader;
+    }
+
+    // use/activate the shader, waiting for its link if that was deferred
     void use() {
+        if (!pendingStages.empty())
+            finishLink();
         glUseProgram(ID);
     }
-    // utility uniform functions
-    void setBool(const std::string& name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+
+    // Set around the creation of many programs: their links are submitted without waiting for
+    // the status, so a driver compiling on its own threads works on all of them at once.
+    // Each program is finished by use(), finishLink() or the static functions below.
+    // Per thread, the reloader's worker always links synchronously.
+    static bool& deferredLinking() {
+        static thread_local bool deferred = false;
+        return deferred;
     }
 
-    void setInt(const std::string& name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    // Lets the driver use as many compiler threads as it likes. glad43 does not load
+    // GL_KHR_parallel_shader_compile, so the entry point comes from the given loader.
+    static void enableParallelCompile(GLADloadproc load) {
+        if (!parallelCompileSupported())
+            return;
+
+        typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+        MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+        if (maxThreads == NULL)
+            maxThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+        if (maxThreads != NULL)
+            maxThreads(0xFFFFFFFF);
     }
 
-    void setFloat(const std::string& name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    // true when the driver can be asked whether a link finished without waiting for it
+    static bool parallelCompileSupported() {
+        static bool supported = hasExtension("GL_KHR_parallel_shader_compile") || hasExtension("GL_ARB_parallel_shader_compile");
+        return supported;
     }
 
-    void setMat4(const string& name, glm::mat4 value) const {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    static bool hasExtension(const char* name) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i) {
+            if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+                return true;
+        }
+        return false;
     }
 
-    void setMat3(const string& name, glm::mat3 value) const {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    typedef void (APIENTRYP SpecializeShaderProc)(GLuint shader, const GLchar* entryPoint, GLuint count,
+        const GLuint* constantIndices, const GLuint* constantValues);
+
+    // Stages precompiled by compile_spirv.bat are loaded from this directory instead of being
+    // compiled from source. Empty, the default, or a driver without ARB_gl_spirv means source.
+    static string& spirvDirectory() {
+        static string directory;
+        return directory;
     }
 
-    void setVec3(const string& name, GLfloat v1, GLfloat v2, GLfloat v3) const {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniform3f(location, v1, v2, v3);
+    // values of the SPIR-V specialization constants, by constant_id
+    static vector<pair<GLuint, GLuint>>& specializationConstants() {
+        static vector<pair<GLuint, GLuint>> constants;
+        return constants;
     }
 
-    void setVec3(const string& name, glm::vec3 value) const {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniform3f(location, value.x, value.y, value.z);
+    // glad43 predates GL 4.6, so glSpecializeShader comes from the given loader
+    static void enableSpirv(GLADloadproc load, const string& directory) {
+        SpecializeShaderProc& specialize = specializeShader();
+        if (hasExtension("GL_ARB_gl_spirv"))
+            specialize = (SpecializeShaderProc)load("glSpecializeShaderARB");
+        if (specialize == NULL)
+            specialize = (SpecializeShaderProc)load("glSpecializeShader");
+        spirvDirectory() = specialize != NULL ? directory : "";
     }
 
+    // programs whose deferred link has not been finished yet
+    static vector<Shader*>& pendingLinks() {
+        static vector<Shader*> shaders;
+        return shaders;
+    }
 
-    void setVec2(const string& name, GLfloat v1, GLfloat v2) const {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniform2f(location, v1, v2);
+    // finishes every deferred link the driver reports as done, returns how many are left
+    static size_t finishCompletedLinks() {
+        vector<Shader*> shaders = pendingLinks();
+        for (Shader* shader : shaders) {
+            if (shader->linkCompleted())
+                shader->finishLink();
+        }
+        return pendingLinks().size();
     }
 
-    void setVec2(const string& name, glm::vec2 value) const {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniform2f(location, value.x, value.y);
+    static void finishAllLinks() {
+        while (!pendingLinks().empty())
+            pendingLinks().back()->finishLink();
     }
-    //hot reload
 
-    unsigned int createShaderProgram(const char* vShaderCode, const char* fShaderCode) {
-        unsigned int vertex, fragment;
-        int success;
-        char infoLog[512];
+    // without the extension there is no way to ask, finishLink() simply blocks
+    bool linkCompleted() const {
+        if (pendingStages.empty() || !parallelCompileSupported())
+            return true;
 
-        // vertex Shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        // print compile errors if any
-        glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-            cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << endl;
-        };
+        GLint completed = 0;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed != 0;
+    }
 
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        // print compile errors if any
-        glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-            cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << endl;
-        };
+    // checks a deferred link, stores the binary and reflects the program
+    void finishLink() {
+        if (pendingStages.empty())
+            return;
+
+        ID = checkLink(ID, pendingStages, pendingCacheKey);
+        pendingStages.clear();
+        pendingCacheKey.clear();
+        vector<Shader*>& pending = pendingLinks();
+        pending.erase(remove(pending.begin(), pending.end(), this), pending.end());
+        reflect();
+    }
+    // Registers a uniform name once and returns a handle valid for every program. Setters
+    // taking a handle index a per-program array instead of hashing the name. Handles made
+    // before a program is linked are resolved by its reflection, later ones on first use.
+    static UniformHandle handle(const string& name) {
+        vector<string>& names = handleNames();
+        for (unsigned int i = 0; i < names.size(); ++i) {
+            if (names[i] == name)
+                return { i };
+        }
+        names.push_back(name);
+        handleExplicitLocations().push_back(-1);
+        return { (unsigned int)names.size() - 1 };
+    }
 
+    // Same for a uniform declared with layout(location = explicitLocation) in every program.
+    // SPIR-V programs carry no uniform names, they only know the uniforms registered this way.
+    static UniformHandle handle(const string& name, GLint explicitLocation) {
+        UniformHandle registered = handle(name);
+        handleExplicitLocations()[registered.index] = explicitLocation;
+        return registered;
+    }
 
-        // shader Program
-        reloadedProgramID = glCreateProgram();
-        glAttachShader(reloadedProgramID, vertex);
-        glAttachShader(reloadedProgramID, fragment);
-        glLinkProgram(reloadedProgramID);
-        // print linking errors if any
-        glGetProgramiv(reloadedProgramID, GL_LINK_STATUS, &success);
-        if (!success)
-        {
-            glGetProgramInfoLog(reloadedProgramID, 512, NULL, infoLog);
-            cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
-            glDeleteShader(vertex);
-            glDeleteShader(fragment);
-            return 0;
-        }
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        return reloadedProgramID;
+    // -1 for names that are not active in this program, setting those is a no-op like in GL
+    GLint location(const string& name) const {
+        unordered_map<string, GLint>::const_iterator found = uniformLocations.find(name);
+        return found == uniformLocations.end() ? -1 : found->second;
     }
 
-    unsigned int createComputeShaderProgram(const char* cShaderCode) {
-        unsigned int compute;
-        int success;
-        char infoLog[512];
+    GLint location(UniformHandle handle) const {
+        if (handle.index < handleLocations.size())
+            return handleLocations[handle.index];
+        return location(handleNames()[handle.index]);
+    }
 
-        compute = glCreateShader(GL_COMPUTE_SHADER);
-        glShaderSource(compute, 1, &cShaderCode, NULL);
-        glCompileShader(compute);
-        // print compile errors if any
-        glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(compute, 512, NULL, infoLog);
-            cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << endl;
-        };
+    // binding points of the active blocks, -1 when the block is not used
+    GLint uniformBlockBinding(const string& name) const {
+        unordered_map<string, GLint>::const_iterator found = uniformBlockBindings.find(name);
+        return found == uniformBlockBindings.end() ? -1 : found->second;
+    }
 
+    GLint storageBlockBinding(const string& name) const {
+        unordered_map<string, GLint>::const_iterator found = storageBlockBindings.find(name);
+        return found == storageBlockBindings.end() ? -1 : found->second;
+    }
 
-        // shader Program
-        reloadedProgramID = glCreateProgram();
-        glAttachShader(reloadedProgramID, compute);
-        glLinkProgram(reloadedProgramID);
-        // print linking errors if any
-        glGetProgramiv(reloadedProgramID, GL_LINK_STATUS, &success);
-        if (!success)
-        {
-            glGetProgramInfoLog(reloadedProgramID, 512, NULL, infoLog);
-            cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
-            glDeleteShader(compute);
-            return 0;
+    // utility uniform functions
+    template<typename Key>
+    void setBool(const Key& name, bool value) const {
+        glUniform1i(location(name), (int)value);
+    }
+
+    template<typename Key>
+    void setInt(const Key& name, int value) const {
+        glUniform1i(location(name), value);
+    }
+
+    template<typename Key>
+    void setUint(const Key& name, unsigned int value) const {
+        glUniform1ui(location(name), value);
+    }
+
+    template<typename Key>
+    void setFloat(const Key& name, float value) const {
+        glUniform1f(location(name), value);
+    }
+
+    template<typename Key>
+    void setMat4(const Key& name, const glm::mat4& value) const {
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    template<typename Key>
+    void setMat3(const Key& name, const glm::mat3& value) const {
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    template<typename Key>
+    void setVec4(const Key& name, const glm::vec4& value) const {
+        glUniform4f(location(name), value.x, value.y, value.z, value.w);
+    }
+
+    template<typename Key>
+    void setVec3(const Key& name, GLfloat v1, GLfloat v2, GLfloat v3) const {
+        glUniform3f(location(name), v1, v2, v3);
+    }
+
+    template<typename Key>
+    void setVec3(const Key& name, const glm::vec3& value) const {
+        glUniform3f(location(name), value.x, value.y, value.z);
+    }
+
+    template<typename Key>
+    void setVec2(const Key& name, GLfloat v1, GLfloat v2) const {
+        glUniform2f(location(name), v1, v2);
+    }
+
+    template<typename Key>
+    void setVec2(const Key& name, const glm::vec2& value) const {
+        glUniform2f(location(name), value.x, value.y);
+    }
+
+    // Rebuilds the location cache and block bindings from the linked program, called after
+    // every successful link so the cache never outlives the program it describes.
+    void reflect() {
+        uniformLocations.clear();
+        uniformBlockBindings.clear();
+        storageBlockBindings.clear();
+        handleLocations.clear();
+        if (ID == 0)
+            return;
+
+        GLint count = 0;
+        unordered_set<GLint> activeLocations;
+        glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+        for (GLint i = 0; i < count; ++i) {
+            const GLenum properties[] = { GL_BLOCK_INDEX, GL_LOCATION };
+            GLint values[2];
+            glGetProgramResourceiv(ID, GL_UNIFORM, i, 2, properties, 2, NULL, values);
+            // members of uniform blocks have no location of their own
+            if (values[0] != -1)
+                continue;
+
+            activeLocations.insert(values[1]);
+            string name = resourceName(GL_UNIFORM, i);
+            if (name.empty())
+                continue;
+            uniformLocations[name] = values[1];
+            // arrays are reported as "name[0]", also accept the bare name like glGetUniformLocation
+            size_t bracket = name.find("[0]");
+            if (bracket != string::npos && bracket + 3 == name.size())
+                uniformLocations[name.substr(0, bracket)] = values[1];
         }
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(compute);
-        return reloadedProgramID;
+
+        // unnamed uniforms of SPIR-V programs, matched to the handles by explicit location
+        const vector<string>& names = handleNames();
+        const vector<GLint>& explicitLocations = handleExplicitLocations();
+        for (size_t i = 0; i < names.size() && precompiled; ++i) {
+            if (explicitLocations[i] >= 0 && uniformLocations.count(names[i]) == 0 && activeLocations.count(explicitLocations[i]) != 0)
+                uniformLocations[names[i]] = explicitLocations[i];
+        }
+
+        reflectBlocks(GL_UNIFORM_BLOCK, uniformBlockBindings);
+        reflectBlocks(GL_SHADER_STORAGE_BLOCK, storageBlockBindings);
+
+        handleLocations.reserve(names.size());
+        for (const string& name : names)
+            handleLocations.push_back(location(name));
+    }
+
+    //hot reload
+
+    unsigned int createShaderProgram(const char* vShaderCode, const char* fShaderCode) {
+        return createProgram({ { GL_VERTEX_SHADER, vShaderCode }, { GL_FRAGMENT_SHADER, fShaderCode } });
+    }
+
+    unsigned int createComputeShaderProgram(const char* cShaderCode) {
+        return createProgram({ { GL_COMPUTE_SHADER, cShaderCode } });
     }
 
     unsigned int createTellShaderProgram(const char* vShaderCode, const char* fShaderCode,
         const char* tcsShaderCode, const char* tesShaderCode) {
-        unsigned int vertex, fragment, tcs, tes;
-        int success;
-        char infoLog[512];
+        return createProgram({ { GL_VERTEX_SHADER, vShaderCode }, { GL_TESS_CONTROL_SHADER, tcsShaderCode },
+            { GL_TESS_EVALUATION_SHADER, tesShaderCode }, { GL_FRAGMENT_SHADER, fShaderCode } });
+    }
 
-        // vertex Shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        // print compile errors if any
-        glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-            cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << endl;
-        };
+    struct StageSource {
+        GLenum type;
+        const char* code;
+    };
+
+    // Compiles and links the stages unless the binary cache has the program, 0 on failure.
+    // While deferredLinking() is set nothing here waits for the driver: the statuses are
+    // checked by finishLink() and the returned program is only usable after it.
+    unsigned int createProgram(const vector<StageSource>& stages) {
+        vector<const char*> sources;
+        for (const StageSource& stage : stages)
+            sources.push_back(stage.code);
+        string cacheKey = ProgramBinaryCache::key(sources);
+        reloadedProgramID = ProgramBinaryCache::load(cacheKey);
+        if (reloadedProgramID != 0)
+            return reloadedProgramID;
+
+        vector<unsigned int> shaders;
+        reloadedProgramID = glCreateProgram();
+        for (const StageSource& stage : stages) {
+            unsigned int shader = glCreateShader(stage.type);
+            glShaderSource(shader, 1, &stage.code, NULL);
+            glCompileShader(shader);
+            glAttachShader(reloadedProgramID, shader);
+            shaders.push_back(shader);
+        }
+        glProgramParameteri(reloadedProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(reloadedProgramID);
 
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        // print compile errors if any
-        glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-            cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << endl;
-        };
+        if (deferredLinking()) {
+            pendingStages = shaders;
+            pendingCacheKey = cacheKey;
+            return reloadedProgramID;
+        }
+        return checkLink(reloadedProgramID, shaders, cacheKey);
+    }
 
-        tcs = glCreateShader(GL_TESS_CONTROL_SHADER);
-        glShaderSource(tcs, 1, &tcsShaderCode, NULL);
-        glCompileShader(tcs);
-        // print compile errors if any
-        glGetShaderiv(tcs, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(tcs, 512, NULL, infoLog);
-            cout << "ERROR::SHADER::TESS_CONTROL::COMPILATION_FAILED\n" << infoLog << endl;
-        };
+    // reports the compile and link errors of a submitted program, 0 if it failed
+    static unsigned int checkLink(unsigned int program, const vector<unsigned int>& shaders, const string& cacheKey) {
+        int success;
+        char infoLog[512];
 
-        tes = glCreateShader(GL_TESS_EVALUATION_SHADER);
-        glShaderSource(tes, 1, &tesShaderCode, NULL);
-        glCompileShader(tes);
         // print compile errors if any
-        glGetShaderiv(tes, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(tes, 512, NULL, infoLog);
-            cout << "ERROR::SHADER::TESS_EVALUATION::COMPILATION_FAILED\n" << infoLog << endl;
-        };
+        for (unsigned int shader : shaders) {
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                GLint type = 0;
+                glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+                glGetShaderInfoLog(shader, 512, NULL, infoLog);
+                cout << "ERROR::SHADER::" << stageName(type) << "::COMPILATION_FAILED\n" << infoLog << endl;
+            }
+        }
 
-        // shader Program
-        reloadedProgramID = glCreateProgram();
-        glAttachShader(reloadedProgramID, vertex);
-        glAttachShader(reloadedProgramID, tcs);
-        glAttachShader(reloadedProgramID, tes);
-        glAttachShader(reloadedProgramID, fragment);
-        glLinkProgram(reloadedProgramID);
         // print linking errors if any
-        glGetProgramiv(reloadedProgramID, GL_LINK_STATUS, &success);
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
         if (!success)
         {
-            glGetProgramInfoLog(reloadedProgramID, 512, NULL, infoLog);
+            glGetProgramInfoLog(program, 512, NULL, infoLog);
             cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
-            glDeleteShader(vertex);
-            glDeleteShader(fragment);
-            glDeleteShader(tcs);
-            glDeleteShader(tes);
-            return 0;
+            glDeleteProgram(program);
+            program = 0;
         }
+        else
+        {
+            if (!cacheKey.empty())
+                ProgramBinaryCache::store(cacheKey, program);
+        }
+
         // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        glDeleteShader(tcs);
-        glDeleteShader(tes);
-        return reloadedProgramID;
+        for (unsigned int shader : shaders)
+            glDeleteShader(shader);
+        return program;
+    }
+
+    static const char* stageName(GLint type) {
+        switch (type) {
+        case GL_VERTEX_SHADER: return "VERTEX";
+        case GL_FRAGMENT_SHADER: return "FRAGMENT";
+        case GL_TESS_CONTROL_SHADER: return "TESS_CONTROL";
+        case GL_TESS_EVALUATION_SHADER: return "TESS_EVALUATION";
+        case GL_COMPUTE_SHADER: return "COMPUTE";
+        default: return "UNKNOWN";
+        }
     }
 
+    // Reads a stage and resolves its #include "file" lines, relative to the including file.
+    // Every file is pasted once per stage, so shared headers need no include guards, and
+    // #line directives keep compile errors pointing at the right file and line.
     string readFile(const char* _path) {
+        return readFile(_path, includedPaths);
+    }
+
+    // same, collecting the includes into the given list instead of includedPaths
+    string readFile(const char* _path, vector<string>& includes) const {
+        string code;
+        vector<string> pasted;
+        if (!preprocess(_path, includes, pasted, code))
+            return "ERROR";
+        return injectDefines(code);
+    }
+
+    static bool readText(const string& path, string& text) {
         ifstream shaderFile;
         shaderFile.exceptions(ifstream::failbit | ifstream::badbit);
         try {
             // open files
-            shaderFile.open(_path);
+            shaderFile.open(path);
             stringstream shaderStream;
             // read file's buffer contents into streams
             shaderStream << shaderFile.rdbuf();
             // close file handlers
             shaderFile.close();
             // convert stream into string
-            return shaderStream.str();
+            text = shaderStream.str();
+            return true;
         }
         catch (std::ifstream::failure e)
         {
-            cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
-            return "ERROR";
+            cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << endl;
+            return false;
         }
     }
 
+    bool preprocess(const string& path, vector<string>& includes, vector<string>& pasted, string& output) const {
+        if (find(pasted.begin(), pasted.end(), path) != pasted.end())
+            return true;
+        pasted.push_back(path);
+
+        string text;
+        if (!readText(path, text))
+            return false;
+
+        size_t slash = path.find_last_of("/\\");
+        string directory = slash == string::npos ? "" : path.substr(0, slash + 1);
+        int sourceIndex = sourceIndexOf(includes, path);
+
+        istringstream lines(text);
+        string line;
+        for (int lineNumber = 1; getline(lines, line); ++lineNumber) {
+            size_t start = line.find_first_not_of(" \t");
+            if (start != string::npos && line.compare(start, 8, "#include") == 0) {
+                size_t open = line.find('"', start);
+                size_t close = open == string::npos ? string::npos : line.find('"', open + 1);
+                if (close == string::npos) {
+                    cout << "ERROR::SHADER::BAD_INCLUDE " << path << "(" << lineNumber << ")" << endl;
+                    return false;
+                }
+                string includePath = directory + line.substr(open + 1, close - open - 1);
+                if (find(includes.begin(), includes.end(), includePath) == includes.end())
+                    includes.push_back(includePath);
+
+                output += "#line 1 " + to_string(sourceIndexOf(includes, includePath)) + "\n";
+                if (!preprocess(includePath, includes, pasted, output))
+                    return false;
+                output += "#line " + to_string(lineNumber + 1) + " " + to_string(sourceIndex) + "\n";
+                continue;
+            }
+            // only there so offline tools accept the #include lines, the driver would reject it
+            if (start != string::npos && line.find("GL_GOOGLE_include_directive", start) != string::npos)
+                line.clear();
+            output += line + "\n";
+        }
+        return true;
+    }
+
+    // 0 for the stage itself, n for includes[n - 1]
+    static int sourceIndexOf(const vector<string>& includes, const string& path) {
+        auto found = find(includes.begin(), includes.end(), path);
+        return found == includes.end() ? 0 : (int)(found - includes.begin()) + 1;
+    }
+
+    // the #version directive has to stay on top, so defines go right after it,
+    // followed by a #line that restores the numbering of the lines below
+    string injectDefines(const string& code) const {
+        string lines = globalDefines() + defines;
+        if (lines.empty())
+            return code;
+
+        size_t versionPos = code.find("#version");
+        if (versionPos == string::npos)
+            return lines + code;
+
+        size_t lineEnd = code.find('\n', versionPos);
+        if (lineEnd == string::npos)
+            return code + "\n" + lines;
+
+        int nextLine = (int)count(code.begin(), code.begin() + lineEnd, '\n') + 2;
+        return code.substr(0, lineEnd + 1) + lines + "#line " + to_string(nextLine) + " 0\n" + code.substr(lineEnd + 1);
+    }
+
+    // Compiles and links a new program from sourcePaths without touching ID, 0 on failure.
+    // Only needs a current context, so it can run on a worker thread with a shared context.
+    // The files it included are returned in includes, to be handed to swapProgram().
+    unsigned int buildProgram(vector<string>& includes) {
+        vector<string> code;
+        for (const string& path : sourcePaths)
+            code.push_back(readFile(path.c_str(), includes));
+
+        switch (code.size()) {
+        case 1:
+            return createComputeShaderProgram(code[0].c_str());
+        case 2:
+            return createShaderProgram(code[0].c_str(), code[1].c_str());
+        case 4:
+            return createTellShaderProgram(code[0].c_str(), code[1].c_str(), code[2].c_str(), code[3].c_str());
+        default:
+            return 0;
+        }
+    }
+
+    // replaces the program by one built with buildProgram(), on the thread that renders with it
+    void swapProgram(unsigned int program, const vector<string>& includes) {
+        glDeleteProgram(ID);
+        ID = program;
+        precompiled = false;
+        includedPaths = includes;
+        reflect();
+        cout << "Reaload succeed.  " << "The program ID is " << ID << endl;
+    }
+
+    // true when the named file (no directory) is one of the sources or their includes
+    bool dependsOn(const string& fileName) const {
+        for (const vector<string>* paths : { &sourcePaths, &includedPaths }) {
+            for (const string& path : *paths) {
+                size_t slash = path.find_last_of("/\\");
+                if ((slash == string::npos ? path : path.substr(slash + 1)) == fileName)
+                    return true;
+            }
+        }
+        return false;
+    }
+
     void reloadShaderProgram(const char* vertexPath, const char* fragmentPath) {
         assert(vertexPath && fragmentPath);
 
@@ -298,6 +650,8 @@ public:
         if (createShaderProgram(vShaderCode, fShaderCode) != 0) {
             glDeleteProgram(ID);
             ID = reloadedProgramID;
+            precompiled = false;
+            reflect();
             cout << "Reaload succeed.  " << "The program ID is " << ID;
         }
     }
@@ -319,6 +673,8 @@ public:
         if (createTellShaderProgram(vShaderCode, fShaderCode, tcsShaderCode, tesShaderCode) != 0) {
             glDeleteProgram(ID);
             ID = reloadedProgramID;
+            precompiled = false;
+            reflect();
             cout << "Reaload succeed.  " << "The program ID is " << ID;
         }
     }
@@ -333,10 +689,152 @@ public:
         if (createComputeShaderProgram(computeShaderCode) != 0) {
             glDeleteProgram(ID);
             ID = reloadedProgramID;
+            precompiled = false;
+            reflect();
             cout << "Reaload succeed.  " << "The program ID is " << ID;
         }
     }
 
+private:
+    unordered_map<string, GLint> uniformLocations;
+    unordered_map<string, GLint> uniformBlockBindings;
+    unordered_map<string, GLint> storageBlockBindings;
+    // locations of the handles registered when the program was reflected, by handle index
+    vector<GLint> handleLocations;
+    // stages of a link submitted with deferredLinking() set, empty once it is finished
+    vector<unsigned int> pendingStages;
+    string pendingCacheKey;
+
+    Shader() : ID(0), reloadedProgramID(0) {
+    }
+
+    // reflects a program that is already linked, or queues one whose link was deferred
+    void finishConstruction() {
+        if (pendingStages.empty())
+            reflect();
+        else
+            pendingLinks().push_back(this);
+    }
+
+    static vector<string>& handleNames() {
+        static vector<string> names;
+        return names;
+    }
+
+    // -1 for handles registered without a location
+    static vector<GLint>& handleExplicitLocations() {
+        static vector<GLint> locations;
+        return locations;
+    }
+
+    static SpecializeShaderProc& specializeShader() {
+        static SpecializeShaderProc specialize = NULL;
+        return specialize;
+    }
+
+    // spirvDirectory() + the source's file name + its flags, e.g. GalaxyShader.vs.STAR_PASS.PACKED_PARTICLES.spv
+    string spirvPath(const string& sourcePath) const {
+        size_t slash = sourcePath.find_last_of("/\\");
+        string path = spirvDirectory() + (slash == string::npos ? sourcePath : sourcePath.substr(slash + 1));
+        // the program's flags, then the global ones; defines with a value are specialization constants
+        istringstream lines(defines + globalDefines());
+        string line;
+        while (getline(lines, line)) {
+            istringstream words(line);
+            string directive, name, value;
+            if (words >> directive >> name && directive == "#define" && !(words >> value))
+                path += "." + name;
+        }
+        return path + ".spv";
+    }
+
+    // the constant_id values a module declares, glSpecializeShader rejects any other
+    static vector<GLuint> specializationIds(const vector<uint32_t>& module) {
+        const uint32_t OP_DECORATE = 71;
+        const uint32_t DECORATION_SPEC_ID = 1;
+        vector<GLuint> ids;
+        // the header is 5 words, then every instruction starts with its word count and opcode
+        for (size_t i = 5; i < module.size();) {
+            uint32_t wordCount = module[i] >> 16;
+            if (wordCount == 0)
+                break;
+            if ((module[i] & 0xffff) == OP_DECORATE && wordCount >= 4 && module[i + 2] == DECORATION_SPEC_ID)
+                ids.push_back(module[i + 3]);
+            i += wordCount;
+        }
+        return ids;
+    }
+
+    // Builds the program from precompiled stages when every one of them exists, see
+    // spirvDirectory(). Hot reloads go back to the source, which is what is being edited.
+    bool loadSpirv() {
+        if (spirvDirectory().empty() || (sourcePaths.size() != 1 && sourcePaths.size() != 2))
+            return false;
+
+        vector<vector<uint32_t>> modules;
+        for (const string& path : sourcePaths) {
+            ifstream file(spirvPath(path), ios::binary | ios::ate);
+            if (!file)
+                return false;
+            vector<uint32_t> module((size_t)file.tellg() / sizeof(uint32_t));
+            file.seekg(0);
+            if (!file.read((char*)module.data(), module.size() * sizeof(uint32_t)))
+                return false;
+            modules.push_back(module);
+        }
+
+        const GLenum stageTypes[2][2] = { { GL_COMPUTE_SHADER }, { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER } };
+        vector<unsigned int> shaders;
+        unsigned int program = glCreateProgram();
+        for (size_t i = 0; i < modules.size(); ++i) {
+            unsigned int shader = glCreateShader(stageTypes[modules.size() - 1][i]);
+            glShaderBinary(1, &shader, GL_SHADER_BINARY_FORMAT_SPIR_V_ARB, modules[i].data(), (GLsizei)(modules[i].size() * sizeof(uint32_t)));
+
+            vector<GLuint> ids, values;
+            vector<GLuint> declared = specializationIds(modules[i]);
+            for (const pair<GLuint, GLuint>& constant : specializationConstants()) {
+                if (find(declared.begin(), declared.end(), constant.first) != declared.end()) {
+                    ids.push_back(constant.first);
+                    values.push_back(constant.second);
+                }
+            }
+            specializeShader()(shader, "main", (GLuint)ids.size(), ids.data(), values.data());
+            glAttachShader(program, shader);
+            shaders.push_back(shader);
+        }
+        glLinkProgram(program);
+
+        // precompiled stages skip the binary cache, an empty key is never stored
+        program = checkLink(program, shaders, "");
+        if (program == 0) {
+            cout << "ERROR::SHADER::SPIRV_FALLBACK " << spirvPath(sourcePaths[0]) << endl;
+            return false;
+        }
+        ID = program;
+        precompiled = true;
+        reflect();
+        return true;
+    }
+
+    string resourceName(GLenum interface, GLint index) const {
+        const GLenum property = GL_NAME_LENGTH;
+        GLint length = 0;
+        glGetProgramResourceiv(ID, interface, index, 1, &property, 1, NULL, &length);
+        vector<char> name(length + 1, 0);
+        glGetProgramResourceName(ID, interface, index, length + 1, NULL, name.data());
+        return string(name.data());
+    }
+
+    void reflectBlocks(GLenum interface, unordered_map<string, GLint>& bindings) {
+        GLint count = 0;
+        glGetProgramInterfaceiv(ID, interface, GL_ACTIVE_RESOURCES, &count);
+        for (GLint i = 0; i < count; ++i) {
+            const GLenum property = GL_BUFFER_BINDING;
+            GLint binding = -1;
+            glGetProgramResourceiv(ID, interface, i, 1, &property, 1, NULL, &binding);
+            bindings[resourceName(interface, i)] = binding;
+        }
+    }
 };
 
 #endif
\ No newline at end of file
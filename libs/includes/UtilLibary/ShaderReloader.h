@@ -0,0 +1,250 @@
+#ifndef SHADER_RELOADER_H
+#define SHADER_RELOADER_H
+
+#include <glad43/glad.h>
+#include <GLFW/glfw3.h>
+#include <UtilLibary/Shader.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+// without these windows.h defines min and max macros that break every glm::min / glm::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Reports the names of files written in one directory. Polled without blocking, through
+// inotify on Linux and an overlapped ReadDirectoryChangesW on Windows.
+class ShaderWatcher
+{
+public:
+    explicit ShaderWatcher(const char* directory) {
+#ifdef _WIN32
+        handle = CreateFileA(directory, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+        overlapped = {};
+        overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (handle == INVALID_HANDLE_VALUE)
+            cout << "ERROR::SHADER_WATCHER::CANNOT_WATCH " << directory << endl;
+        else
+            startRead();
+#else
+        descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (descriptor < 0 || inotify_add_watch(descriptor, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+            cout << "ERROR::SHADER_WATCHER::CANNOT_WATCH " << directory << endl;
+#endif
+    }
+
+    ~ShaderWatcher() {
+#ifdef _WIN32
+        if (handle != INVALID_HANDLE_VALUE) {
+            CancelIo(handle);
+            CloseHandle(handle);
+        }
+        CloseHandle(overlapped.hEvent);
+#else
+        if (descriptor >= 0)
+            close(descriptor);
+#endif
+    }
+
+    // names written since the last call, editors often report a save several times
+    vector<string> poll() {
+        vector<string> names;
+#ifdef _WIN32
+        DWORD bytes = 0;
+        if (handle == INVALID_HANDLE_VALUE || !GetOverlappedResult(handle, &overlapped, &bytes, FALSE))
+            return names;
+
+        size_t offset = 0;
+        while (bytes > 0) {
+            const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)(buffer + offset);
+            int length = WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), NULL, 0, NULL, NULL);
+            string name(length, '\0');
+            WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), &name[0], length, NULL, NULL);
+            addName(names, name);
+            if (info->NextEntryOffset == 0)
+                break;
+            offset += info->NextEntryOffset;
+        }
+        startRead();
+#else
+        if (descriptor < 0)
+            return names;
+
+        ssize_t length;
+        while ((length = read(descriptor, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t offset = 0; offset < length;) {
+                const inotify_event* event = (const inotify_event*)(buffer + offset);
+                if (event->len > 0)
+                    addName(names, event->name);
+                offset += sizeof(inotify_event) + event->len;
+            }
+        }
+#endif
+        return names;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle;
+    OVERLAPPED overlapped;
+    alignas(DWORD) char buffer[16 * 1024];
+
+    void startRead() {
+        ResetEvent(overlapped.hEvent);
+        ReadDirectoryChangesW(handle, buffer, sizeof(buffer), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, NULL, &overlapped, NULL);
+    }
+#else
+    int descriptor;
+    alignas(inotify_event) char buffer[16 * 1024];
+#endif
+
+    static void addName(vector<string>& names, const string& name) {
+        if (find(names.begin(), names.end(), name) == names.end())
+            names.push_back(name);
+    }
+};
+
+// Rebuilds programs whose sources changed on a worker thread that owns a hidden window
+// sharing the main context. The worker links, fences and hands the program back; poll()
+// swaps it in on the render thread once the fence has signaled, so a frame never waits for
+// a compile and never sees a half built program. Failed builds keep the old program.
+class ShaderReloader
+{
+public:
+    ShaderReloader(GLFWwindow* mainWindow, const char* directory) : watcher(directory), running(true) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        workerWindow = glfwCreateWindow(1, 1, "shader compiler", NULL, mainWindow);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        if (workerWindow == NULL) {
+            cout << "ERROR::SHADER_RELOADER::NO_SHARED_CONTEXT" << endl;
+            running = false;
+            return;
+        }
+        worker = thread(&ShaderReloader::work, this);
+    }
+
+    ~ShaderReloader() {
+        {
+            lock_guard<mutex> lock(jobMutex);
+            running = false;
+        }
+        jobReady.notify_one();
+        if (worker.joinable())
+            worker.join();
+        if (workerWindow != NULL)
+            glfwDestroyWindow(workerWindow);
+    }
+
+    // registers a program for reloading and returns it, so creation and registration read as one
+    Shader* watch(Shader* shader) {
+        shaders.push_back(shader);
+        return shader;
+    }
+
+    void requestReload(Shader* shader) {
+        {
+            lock_guard<mutex> lock(jobMutex);
+            if (find(pending.begin(), pending.end(), shader) != pending.end())
+                return;
+            pending.push_back(shader);
+        }
+        jobReady.notify_one();
+    }
+
+    void requestAll() {
+        for (Shader* shader : shaders)
+            requestReload(shader);
+    }
+
+    // Call once per frame on the render thread. Queues the programs that depend on changed
+    // files and returns the ones swapped in during this call.
+    vector<Shader*> poll() {
+        for (const string& name : watcher.poll()) {
+            for (Shader* shader : shaders) {
+                if (shader->dependsOn(name))
+                    requestReload(shader);
+            }
+        }
+
+        vector<Shader*> swapped;
+        lock_guard<mutex> lock(doneMutex);
+        while (!done.empty()) {
+            BuiltProgram& built = done.front();
+            if (glClientWaitSync(built.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                break;
+            glDeleteSync(built.fence);
+            built.shader->swapProgram(built.program, built.includes);
+            swapped.push_back(built.shader);
+            done.pop_front();
+        }
+        return swapped;
+    }
+
+private:
+    struct BuiltProgram {
+        Shader* shader;
+        unsigned int program;
+        GLsync fence;
+        vector<string> includes;
+    };
+
+    ShaderWatcher watcher;
+    vector<Shader*> shaders;
+    GLFWwindow* workerWindow;
+    thread worker;
+    bool running;
+
+    mutex jobMutex;
+    condition_variable jobReady;
+    deque<Shader*> pending;
+
+    mutex doneMutex;
+    deque<BuiltProgram> done;
+
+    void work() {
+        glfwMakeContextCurrent(workerWindow);
+        for (;;) {
+            Shader* shader;
+            {
+                unique_lock<mutex> lock(jobMutex);
+                jobReady.wait(lock, [this]() { return !running || !pending.empty(); });
+                if (!running)
+                    break;
+                shader = pending.front();
+                pending.pop_front();
+            }
+
+            vector<string> includes;
+            unsigned int program = shader->buildProgram(includes);
+            if (program == 0)
+                continue;
+
+            // the render thread may only use the program once this context finished it
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            lock_guard<mutex> lock(doneMutex);
+            done.push_back({ shader, program, fence, includes });
+        }
+        glfwMakeContextCurrent(NULL);
+    }
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <UtilLibary/Shader.h>
+#include <UtilLibary/ShaderReloader.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+using namespace std;
+
+// The programs built from one vertex + fragment pair, one per combination of feature bits.
+// Bit i adds "#define features[i]" on top of the family's own defines. A variant is compiled
+// the first time get() asks for it, or up front by precompile() from a manifest, and every
+// compile goes through the program binary cache like any other Shader.
+class ShaderVariants
+{
+public:
+    // the family's name is its define without the "#define ", e.g. STAR_PASS
+    ShaderVariants(const char* _vertexPath, const char* _fragmentPath, const string& _name,
+        const vector<string>& _features, ShaderReloader* _reloader = NULL)
+        : vertexPath(_vertexPath), fragmentPath(_fragmentPath), name(_name), features(_features),
+        reloader(_reloader), programs((size_t)1 << _features.size(), NULL), lazyBuilds(0) {
+    }
+
+    Shader* get(unsigned int mask) {
+        Shader*& program = programs[mask];
+        if (program == NULL) {
+            program = build(mask);
+            ++lazyBuilds;
+            cout << "Shader variant built on first use: " << describe(mask) << endl;
+        }
+        return program;
+    }
+
+    // builds the variants listed for this family, see readManifest()
+    void precompile(const vector<string>& manifest) {
+        for (const string& line : manifest) {
+            istringstream words(line);
+            string family;
+            words >> family;
+            if (family != name)
+                continue;
+
+            unsigned int mask = 0;
+            string feature;
+            bool known = true;
+            while (words >> feature) {
+                size_t bit = 0;
+                while (bit < features.size() && features[bit] != feature)
+                    ++bit;
+                if (bit == features.size()) {
+                    cout << "ERROR::SHADER_VARIANTS::UNKNOWN_FEATURE " << feature << " in " << name << endl;
+                    known = false;
+                    break;
+                }
+                mask |= 1u << bit;
+            }
+            if (known && programs[mask] == NULL)
+                programs[mask] = build(mask);
+        }
+    }
+
+    // programs get() had to compile while rendering, a manifest entry would have saved each one
+    unsigned int lazyBuildCount() const {
+        return lazyBuilds;
+    }
+
+    // the family name followed by the feature names of the mask, the manifest line for it
+    string describe(unsigned int mask) const {
+        string text = name;
+        for (size_t bit = 0; bit < features.size(); ++bit) {
+            if (mask & (1u << bit))
+                text += " " + features[bit];
+        }
+        return text;
+    }
+
+    // One variant per line: the family name, then its feature names. Empty lines and lines
+    // starting with # are skipped. A missing manifest just means every variant is lazy.
+    static vector<string> readManifest(const char* path) {
+        vector<string> lines;
+        ifstream file(path);
+        string line;
+        while (getline(file, line)) {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == string::npos || line[start] == '#')
+                continue;
+            lines.push_back(line.substr(start));
+        }
+        return lines;
+    }
+
+private:
+    string vertexPath;
+    string fragmentPath;
+    string name;
+    vector<string> features;
+    ShaderReloader* reloader;
+    vector<Shader*> programs;
+    unsigned int lazyBuilds;
+
+    Shader* build(unsigned int mask) {
+        string defines = "#define " + name + "\n";
+        for (size_t bit = 0; bit < features.size(); ++bit) {
+            if (mask & (1u << bit))
+                defines += "#define " + features[bit] + "\n";
+        }
+
+        Shader* program = new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines);
+        return reloader != NULL ? reloader->watch(program) : program;
+    }
+};
+
+#endif
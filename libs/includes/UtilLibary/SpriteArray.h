@@ -0,0 +1,137 @@
+#ifndef SPRITE_ARRAY_H
+#define SPRITE_ARRAY_H
+
+#include <glad43/glad.h>
+#include <UtilLibary/stb_image.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+
+// A mipmapped RGBA8 texture array with one square sprite per layer. The constructor starts
+// decoding the files with stb_image on a worker thread, so the caller can keep working;
+// upload() waits for it and creates the whole texture at once. A layer whose file is
+// missing or unreadable is drawn by the fallback instead.
+// Each layer's average over its inscribed disk is measured while uploading, for particles too
+// small to sample the sprite: the alpha weighted color in rgb and the mean alpha in a.
+class SpriteArray
+{
+public:
+    // fills size * size RGBA pixels for a layer
+    typedef function<void(int layer, int size, unsigned char* rgba)> Fallback;
+
+    unsigned int texture;
+
+    SpriteArray(const vector<string>& paths, int _size, Fallback fallback) : texture(0), size(_size) {
+        decoded = async(launch::async, [paths, fallback, this]() { return decode(paths, fallback); });
+    }
+
+    unsigned int upload() {
+        vector<unsigned char> pixels = decoded.get();
+        diskAverages = averageDisks(pixels);
+        int layers = (int)(pixels.size() / ((size_t)size * size * 4));
+        int levels = (int)log2((double)size) + 1;
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, size, size, layers);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, size, size, layers, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    // valid once upload() returned
+    const glm::vec4& diskAverage(int layer) const {
+        return diskAverages[layer];
+    }
+
+private:
+    int size;
+    future<vector<unsigned char>> decoded;
+    vector<glm::vec4> diskAverages;
+
+    // runs on the worker thread, no GL calls in here
+    vector<unsigned char> decode(const vector<string>& paths, const Fallback& fallback) const {
+        size_t layerBytes = (size_t)size * size * 4;
+        vector<unsigned char> pixels(layerBytes * paths.size());
+
+        for (size_t layer = 0; layer < paths.size(); ++layer) {
+            unsigned char* target = &pixels[layer * layerBytes];
+            int width, height, channels;
+            unsigned char* image = stbi_load(paths[layer].c_str(), &width, &height, &channels, 4);
+            if (!image) {
+                cout << "Sprite " << paths[layer] << " not loaded, using the procedural one" << endl;
+                fallback((int)layer, size, target);
+                continue;
+            }
+
+            resample(image, width, height, target);
+            stbi_image_free(image);
+        }
+        return pixels;
+    }
+
+    // Averaging the premultiplied color and dividing by the mean alpha keeps the transparent
+    // corners of straight alpha sprites from tinting the result, and the disk, not the whole
+    // square, is what a particle covers, whatever shape its sprite has.
+    vector<glm::vec4> averageDisks(const vector<unsigned char>& pixels) const {
+        size_t layerBytes = (size_t)size * size * 4;
+        vector<glm::vec4> averages;
+        for (size_t offset = 0; offset < pixels.size(); offset += layerBytes) {
+            glm::vec3 premultiplied(0.0f);
+            float alpha = 0.0f;
+            int count = 0;
+            for (int y = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                    glm::vec2 centered = 2.0f * (glm::vec2(x + 0.5f, y + 0.5f) / (float)size - 0.5f);
+                    if (glm::dot(centered, centered) > 1.0f)
+                        continue;
+                    const unsigned char* texel = &pixels[offset + (y * size + x) * 4];
+                    float a = texel[3] / 255.0f;
+                    premultiplied += glm::vec3(texel[0], texel[1], texel[2]) / 255.0f * a;
+                    alpha += a;
+                    ++count;
+                }
+            }
+            glm::vec3 color = alpha > 0.0f ? premultiplied / alpha : glm::vec3(0.0f);
+            averages.push_back(glm::vec4(color, alpha / glm::max(count, 1)));
+        }
+        return averages;
+    }
+
+    // bilinear, the files do not need to match the array size
+    void resample(const unsigned char* image, int width, int height, unsigned char* target) const {
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                float u = (x + 0.5f) * width / size - 0.5f;
+                float v = (y + 0.5f) * height / size - 0.5f;
+                int x0 = max(0, min(width - 1, (int)floor(u)));
+                int y0 = max(0, min(height - 1, (int)floor(v)));
+                int x1 = min(width - 1, x0 + 1);
+                int y1 = min(height - 1, y0 + 1);
+                float fx = max(0.0f, min(1.0f, u - x0));
+                float fy = max(0.0f, min(1.0f, v - y0));
+
+                for (int c = 0; c < 4; ++c) {
+                    float top = image[(y0 * width + x0) * 4 + c] * (1.0f - fx) + image[(y0 * width + x1) * 4 + c] * fx;
+                    float bottom = image[(y1 * width + x0) * 4 + c] * (1.0f - fx) + image[(y1 * width + x1) * 4 + c] * fx;
+                    target[(y * size + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+                }
+            }
+        }
+    }
+};
+
+#endif